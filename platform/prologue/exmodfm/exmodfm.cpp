@@ -0,0 +1,1101 @@
+/*  Extended Modified Frequency Modulation oscillator
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "userosc.h"
+#include "modfm.hpp"
+#include "halfband.hpp"
+#include "smoother.hpp"
+#include "osc_prof.h"
+
+typedef dsp::UnitMath Math;
+typedef dsp::ModFMOperator<Math> ModFMOp;
+
+#define ONEOPI2 0.1591549f
+#define MODMAX 15.f
+
+// pitch-dependent index limiting, on by default
+#ifndef EXMODFM_LIMIT
+#define EXMODFM_LIMIT (1)
+#endif
+
+// 2x oversampled rendering, off by default
+#ifndef EXMODFM_OVERSAMPLE
+#define EXMODFM_OVERSAMPLE (0)
+#endif
+
+// operators (2 - 4), the carrier/modulator pair plus up to two
+// more in a series or parallel stack
+#ifndef EXMODFM_NOPS
+#ifdef OSC_HOST
+#define EXMODFM_NOPS (4)
+#else
+#define EXMODFM_NOPS (2)
+#endif
+#endif
+#if EXMODFM_NOPS < 2 || EXMODFM_NOPS > 4
+#error "EXMODFM_NOPS must be 2 - 4"
+#endif
+
+// additive (Bessel) path for low index, off by default: used
+// for blocks where the index times max(|r|,|s|) stays under
+// k_exmodfm_bessel_max, with up to k_exmodfm_nside sidebands
+// a side, as many as needed to bring the first one left out
+// under k_exmodfm_bessel_tol
+#ifndef EXMODFM_BESSEL
+#define EXMODFM_BESSEL (0)
+#endif
+#define k_exmodfm_nside (3)
+#define k_exmodfm_bessel_max (0.4f)
+#define k_exmodfm_bessel_tol (1e-3f)
+
+// unison copies (1 - 8): the maximum on the host, where the
+// count is a parameter, the count on the prologue; detune
+// is the spread between the outer copies, in cents
+#ifndef EXMODFM_UNISON
+#ifdef OSC_HOST
+#define EXMODFM_UNISON (7)
+#else
+#define EXMODFM_UNISON (1)
+#endif
+#endif
+#if EXMODFM_UNISON < 1 || EXMODFM_UNISON > 8
+#error "EXMODFM_UNISON must be 1 - 8"
+#endif
+// the oversampled path renders a single copy; on the host both are
+// runtime parameters and oversampling takes precedence
+#if EXMODFM_UNISON > 1 && EXMODFM_OVERSAMPLE && !defined(OSC_HOST)
+#error "EXMODFM_UNISON and EXMODFM_OVERSAMPLE cannot be combined"
+#endif
+#ifndef EXMODFM_DETUNE
+#define EXMODFM_DETUNE (20)
+#endif
+
+// fixed-point kernel for the carrier/modulator pair and its
+// unison copies, off by default; always built in on the host,
+// where it is a parameter
+#ifndef EXMODFM_FIXED
+#define EXMODFM_FIXED (0)
+#endif
+#if EXMODFM_FIXED || defined(OSC_HOST)
+#include "fixedmodfm.hpp"
+#define k_exmodfm_fixed_path (1)
+#else
+#define k_exmodfm_fixed_path (0)
+#endif
+
+// index ramp breakpoint spacing, also the oversampling and
+// stack chunk size
+#define k_exmodfm_subblock (16)
+
+// decimator output bound, the largest float under 1, as
+// f32_to_q31 wraps at 1.0
+#define k_exmodfm_clip (0.99999994f)
+
+// retrigger crossfade length, in frames at 48 kHz, scaled to
+// the sample rate in OSC_INIT
+#define k_exmodfm_xfade (64)
+
+// largest block, as on the prologue
+#define k_exmodfm_maxframes (64)
+
+// time constant of the shape, shift-shape and menu parameters (s)
+#define k_exmodfm_smooth (0.01f)
+
+// note-on position within the block, in 1/256 frames: passed
+// by the host driver, always at the block start on the prologue
+#ifdef OSC_HOST
+#include "osc_host.h"
+#else
+#define osc_noteon_offset(p) (0)
+#endif
+
+// The kernel controls over a block: static index plus LFO,
+// and the shape weights r and s, from their values at the
+// block start, ramping linearly by dk, dr and ds per frame
+struct KernelRamp {
+  float k, r, s;
+  float dk, dr, ds;
+
+  // the same ramps, from n frames into the block
+  KernelRamp from(uint32_t n) const {
+    KernelRamp b = *this;
+    b.k += dk*n;
+    b.r += dr*n;
+    b.s += ds*n;
+    return b;
+  }
+};
+
+// Piecewise-linear index trajectory: envelope times amount,
+// plus the static index and the LFO ramping by kinc per frame,
+// with breakpoints every k_exmodfm_subblock frames, clamped
+// to kmax there; the renderers step r and s by dr and ds
+// per frame alongside
+struct IndexRamp {
+  float amnt, koff, kinc, kmax, m;
+  float dr, ds;
+
+  IndexRamp(float a, const KernelRamp &b, float km, float e) :
+    amnt(a), koff(b.k), kinc(b.dk), kmax(km), m(clamp(a*e + b.k)),
+    dr(b.dr), ds(b.ds) { };
+
+  float clamp(float x) const { return x < kmax ? x : kmax; }
+
+  // move to the next breakpoint, n frames ahead, and
+  // return the increment per frame
+  float step(dsp::ADSREnvelope &env, uint32_t n) {
+    const float m0 = m;
+    koff += kinc*n;
+    m = clamp(amnt*env.proc(n) + koff);
+    return (m - m0) / n;
+  }
+};
+
+// shape mappings, selected with the car ratio parameter
+enum {
+  k_exmodfm_map_sweep = 0, // shape sweeps r/s, shift-shape is the index
+  k_exmodfm_map_rs         // shape is s, shift-shape is r
+};
+
+// stack algorithms
+enum {
+  k_exmodfm_alg_series = 0, // each operator modulates the next one down
+  k_exmodfm_alg_parallel    // all operators modulate the carrier
+};
+
+// an operator above the modulator; r, s and ndx set how it
+// modulates its target
+struct ExtOp {
+  float ratio, r, s, ndx;
+
+  ExtOp() : ratio(1.f), r(0.f), s(1.f), ndx(0.f) { };
+};
+
+// the state a note carries from block to block: operator
+// phases (carrier, modulator, then operators 3 - N),
+// envelope and decimator, and in unison mode the carrier and
+// modulator phases of each copy, SoA
+struct Voice {
+  float phase[EXMODFM_NOPS];
+  dsp::ADSREnvelope env;
+  dsp::HalfBandDecimator hb;
+#if EXMODFM_UNISON > 1
+  float uc[EXMODFM_UNISON], um[EXMODFM_UNISON];
+#endif
+
+  Voice() : env(), hb() {
+    for (int j = 0; j < EXMODFM_NOPS; j++) phase[j] = 0.f;
+#if EXMODFM_UNISON > 1
+    for (int j = 0; j < EXMODFM_UNISON; j++) uc[j] = um[j] = 0.f;
+#endif
+  };
+};
+
+typedef dsp::Smoother<dsp::k_smooth_onepole> ParamSmoother;
+
+struct PSModFM {
+  int reset, map;
+  int nops, alg;
+  uint32_t ofs, xf;
+  // crossfade length at the sample rate and its reciprocal
+  uint32_t xfade;
+  float xfinc;
+  float ndx;
+  float r, s;
+  // shape, shift-shape, mod fine and env amount, smoothed at
+  // block rate, and the static index plus LFO, ramped over
+  // each block
+  ParamSmoother shape, shift, amnt;
+  dsp::Smoother<dsp::k_smooth_exp> fine;
+  dsp::Smoother<dsp::k_smooth_linear> koff;
+  float car, mod;
+  // envelope attack, decay and release (0 - 1, as 0 - 10 s)
+  // and sustain level
+  float att, dcy, sus, rel;
+  float g0;
+  bool limit, os, bessel, fixed, smooth;
+  // the sounding note, the one fading out after a retrigger
+  // and the envelope of the next one
+  Voice v, tail;
+  dsp::ADSREnvelope nenv;
+  ExtOp xop[EXMODFM_NOPS > 2 ? EXMODFM_NOPS - 2 : 1];
+#if EXMODFM_UNISON > 1
+  // unison copy count and frequency ratios, spread evenly
+  // over +/- half the detune
+  int nuni;
+  float detune;
+  float uratio[EXMODFM_UNISON];
+#endif
+
+  PSModFM() :  reset(1), map(k_exmodfm_map_sweep),
+               nops(2), alg(k_exmodfm_alg_series), ofs(0), xf(0),
+               xfade(k_exmodfm_xfade), xfinc(1.f / k_exmodfm_xfade),
+               ndx(0.f), r(0.f), s(1.f), shape(), shift(), amnt(),
+               fine(1.f), koff(), car(1.f), mod(1.f),
+               att(0.f), dcy(MODFM_ENV_DECAY * 0.01f),
+               sus(MODFM_ENV_SUSTAIN * 0.01f), rel(0.f), g0(ModFMOp::exp(0.f)),
+               limit(EXMODFM_LIMIT), os(EXMODFM_OVERSAMPLE),
+               bessel(EXMODFM_BESSEL), fixed(EXMODFM_FIXED), smooth(false),
+               v(), tail(), nenv() {
+#if EXMODFM_UNISON > 1
+#ifdef OSC_HOST
+    nuni = 1;
+#else
+    nuni = EXMODFM_UNISON;
+#endif
+    detune = EXMODFM_DETUNE;
+    set_unison();
+#endif
+  };
+
+  // parameters set before the first block, with no smoothing
+  // time yet, take effect at once
+  void start_smoothing() {
+    smooth = true;
+    shape.time(k_exmodfm_smooth);
+    shift.time(k_exmodfm_smooth);
+    amnt.time(k_exmodfm_smooth);
+    fine.time(k_exmodfm_smooth);
+  }
+
+#if EXMODFM_UNISON > 1
+  void set_unison() {
+    for (int j = 0; j < nuni; j++) {
+      const float d = nuni > 1 ? (float) j / (nuni - 1) - 0.5f : 0.f;
+      uratio[j] = Math::pow2(d*detune*(1.f/1200.f));
+    }
+  }
+
+  // starting phases, spread so that the copies do not all
+  // peak together at the note-on
+  static float uphase(int j) {
+    const float p = j*0.618034f;
+    return p - (uint32_t) p;
+  }
+#endif
+    
+
+  // kernel specialised on the spectral shape: R is false
+  // for r == 0 (no exp), S is false for s == 0 (no phase
+  // modulation); the unused branches fold at compile time.
+  // g0, the operator level, keeps the level of the reduced
+  // kernels matched to the general one (and below full scale)
+  template<bool R, bool S>
+  float synthesise(float k, float r, float s, float pc, float pm) {
+    if (R && S) {
+      const f32pair_t sc = Math::sincos(pm);
+      const float ph = dsp::PhaseAccumulator::wrap(pc + s*k*ONEOPI2*sc.a);
+      return ModFMOp::amp(r*k, sc.b)*Math::cos(ph);
+    } else if (R) {
+      return ModFMOp::amp(r*k, Math::cos(pm))*Math::cos(pc);
+    } else if (S) {
+      const float ph =
+        dsp::PhaseAccumulator::wrap(pc + s*k*ONEOPI2*Math::sin(pm));
+      return g0*Math::cos(ph);
+    }
+    return g0*Math::cos(pc);
+  }
+
+  // set r, s and the index offset from shape and shift-shape
+  void set_shape() {
+    const float shape = this->shape.val(), shift = this->shift.val();
+    if (map == k_exmodfm_map_sweep) {
+      // classic FM -> lower sidebands -> ModFM -> upper sidebands
+      // -> classic FM, over four regions
+      float vf = shape*4.f;
+      vf = vf < 4.f ?  vf - (uint32_t) vf : 1.;
+      if (shape < 0.25f) {
+        r = vf;
+        s = 1.f - vf*2;
+      } else if  (shape < 0.5f) {
+        r = 1.f;
+        s = vf - 1.f;
+      } else if (shape < 0.75f) {
+        r = 1.f;
+        s = vf;
+      } else {
+        r = 1.f - vf;
+        s = 1.f;
+      }
+      ndx = shift;
+    } else {
+      s = 2.f*shape - 1.f;
+      r = shift;
+      ndx = 0.f;
+    }
+    r = snap(r);
+    s = snap(s);
+  }
+
+  // sideband weights c[N+n], n = -N..N, of the kernel at
+  // index k: exp(rk cos(t) + i sk sin(t)) = exp(a e^{it}) exp(b e^{-it}),
+  // a = k(r+s)/2, b = k(r-s)/2, expanded as power series
+  // (e^{-k} I_n(k) for ModFM), times exp(-rk); sidebands
+  // outside nlo - nhi are left out. The gain is scaled by g0,
+  // matching the level of the exp path (and staying under
+  // full scale, with the Faster exp at most 2% high)
+  template<int N>
+  void sidebands(float k, float r, float s, int nlo, int nhi, float *c) {
+    const float a = 0.5f*k*(r+s), b = 0.5f*k*(r-s);
+    const float g = g0*Math::exp(-r*k);
+    float fa[2*N+1], fb[2*N+1];
+    fa[0] = fb[0] = 1.f;
+    for (int i = 1; i <= 2*N; i++) {
+      const float i1 = 1.f / i;
+      fa[i] = fa[i-1]*a*i1;
+      fb[i] = fb[i-1]*b*i1;
+    }
+    for (int n = 0; n <= N; n++) {
+      float cp = 0.f, cm = 0.f;
+      for (int j = 0; j <= N; j++) {
+        cp += fa[n+j]*fb[j];
+        cm += fb[n+j]*fa[j];
+      }
+      c[N+n] = n <= nhi ? g*cp : 0.f;
+      c[N-n] = -n >= nlo ? g*cm : 0.f;
+    }
+  }
+
+  // shape weights within four parameter steps of 0 are
+  // snapped to it, so the reduced kernels can be reached;
+  // renders near r = 0 and s = 0 change accordingly
+  static float snap(float x) {
+    return fabsf(x) < 4.f / 1023.f ? 0.f : x;
+  }
+
+  // largest index keeping the spectrum below fmax:
+  // sidebands wc + n*wm extend to n = g + 2*sqrt(g) + 1,
+  // with g = k*max(|r|,|s|) (Carson's rule, widened for
+  // the one-sided Poisson spread of ModFM)
+  float max_index(float wc, float wm, float r, float s, float fmax) {
+    const float rs = fmaxf(fabsf(r), fabsf(s));
+    const float n = (fmax - wc) / wm;
+    if (n <= 1.f) return 0.f;
+    const float b = sqrtf(n) - 1.f;
+    return rs*MODMAX > b*b ? b*b / rs : MODMAX;
+  }
+      
+
+
+};
+
+static PSModFM obj;
+
+// extended parameters, set by host builds only
+enum {
+  k_exmodfm_param_limit = k_num_user_osc_param_id, // index limiting
+  k_exmodfm_param_os,                              // 2x oversampling
+  k_exmodfm_param_nops,                            // operator count
+  k_exmodfm_param_alg,                             // stack algorithm
+  k_exmodfm_param_op,     // ratio, r, s and ndx of operator 3, then 4
+  k_exmodfm_param_op_last = k_exmodfm_param_op + 4*(EXMODFM_NOPS - 2) - 1,
+  k_exmodfm_param_bessel = k_exmodfm_param_op + 8, // additive path
+  k_exmodfm_param_unison,                          // unison copies
+  k_exmodfm_param_detune,                          // unison detune
+  k_exmodfm_param_fixed,                           // fixed-point path
+  k_exmodfm_param_decay,                           // envelope decay
+  k_exmodfm_param_sustain                          // envelope sustain
+};
+
+template<bool R, bool S>
+void render(Voice &v, q31_t *__restrict y, uint32_t frames, float wc,
+            float wm, float r, float s, IndexRamp &ix) {
+  dsp::ADSREnvelope &env = v.env;
+  float phase = v.phase[0];
+  float phasem = v.phase[1];
+
+  if (!obj.os) {
+    for (uint32_t n = 0; n < frames; n += k_exmodfm_subblock) {
+      const uint32_t len = frames - n < k_exmodfm_subblock ?
+        frames - n : k_exmodfm_subblock;
+      float m = ix.m;
+      const float dm = ix.step(env, len);
+      for (uint32_t i = n; i < n + len; i++) {
+        m += dm;
+        const float sig = obj.synthesise<R,S>(m,r,s,phase,phasem);
+        y[i] = f32_to_q31(sig);
+        dsp::PhaseAccumulator::advance(phase, wc);
+        dsp::PhaseAccumulator::advance(phasem, wm);
+        r += ix.dr;
+        s += ix.ds;
+      }
+    }
+  } else {
+    // two samples per frame at half the increments,
+    // index at the output rate
+    const float wc2 = 0.5f*wc, wm2 = 0.5f*wm;
+    float buf[2*k_exmodfm_subblock];
+    for (uint32_t n = 0; n < frames; n += k_exmodfm_subblock) {
+      const uint32_t len = frames - n < k_exmodfm_subblock ?
+        frames - n : k_exmodfm_subblock;
+      float m = ix.m;
+      const float dm = ix.step(env, len);
+      for (uint32_t i = 0; i < 2*len; i += 2) {
+        m += dm;
+        buf[i] = obj.synthesise<R,S>(m,r,s,phase,phasem);
+        dsp::PhaseAccumulator::advance(phase, wc2);
+        dsp::PhaseAccumulator::advance(phasem, wm2);
+        buf[i+1] = obj.synthesise<R,S>(m,r,s,phase,phasem);
+        dsp::PhaseAccumulator::advance(phase, wc2);
+        dsp::PhaseAccumulator::advance(phasem, wm2);
+        r += ix.dr;
+        s += ix.ds;
+      }
+      OSC_PROF_BEGIN(dec, "decimate");
+      v.hb.process(buf, buf, len);
+      // the decimator overshoots on steps, as at the note-on
+      for (uint32_t i = 0; i < len; i++)
+        y[n+i] = f32_to_q31(clipminmaxf(-1.f, buf[i], k_exmodfm_clip));
+      OSC_PROF_END(dec, len);
+    }
+  }
+  v.phase[0] = phase;
+  v.phase[1] = phasem;
+}
+
+// additive path, N sidebands a side: a Chebyshev recursion
+// over cos(pc + n pm), weights interpolated between breakpoints
+template<int N>
+void render_bessel(Voice &v, q31_t *__restrict y, uint32_t frames, float wc,
+                   float wm, float r, float s, IndexRamp &ix,
+                   int nlo, int nhi) {
+  dsp::ADSREnvelope &env = v.env;
+  float phase = v.phase[0];
+  float phasem = v.phase[1];
+  float c[2*N+1], c1[2*N+1], dc[2*N+1];
+
+  obj.sidebands<N>(ix.m, r, s, nlo, nhi, c);
+  for (uint32_t n = 0; n < frames; n += k_exmodfm_subblock) {
+    const uint32_t len = frames - n < k_exmodfm_subblock ?
+      frames - n : k_exmodfm_subblock;
+    const float len1 = 1.f / len;
+    // weights held when the index and shape are steady
+    const bool ramp = ix.step(env, len) != 0.f || ix.dr != 0.f ||
+      ix.ds != 0.f;
+    if (ramp) {
+      r += ix.dr*len;
+      s += ix.ds*len;
+      obj.sidebands<N>(ix.m, r, s, nlo, nhi, c1);
+      for (int j = 0; j <= 2*N; j++) dc[j] = (c1[j] - c[j])*len1;
+    }
+    for (uint32_t i = n; i < n + len; i++) {
+      if (ramp)
+        for (int j = 0; j <= 2*N; j++) c[j] += dc[j];
+      const float cm2 = 2.f*Math::cos(phasem);
+      const float x0 = Math::cos(phase);
+      float pc = phase + phasem;
+      pc -= (uint32_t) pc;
+      float acc = c[N]*x0;
+      float xp = x0, xn = Math::cos(pc);
+      for (int j = 1; j <= N; j++) {
+        acc += c[N+j]*xn;
+        const float x = cm2*xn - xp;
+        xp = xn;
+        xn = x;
+      }
+      xp = x0;
+      xn = cm2*x0 - Math::cos(pc);
+      for (int j = 1; j <= N; j++) {
+        acc += c[N-j]*xn;
+        const float x = cm2*xn - xp;
+        xp = xn;
+        xn = x;
+      }
+      y[i] = f32_to_q31(acc);
+      dsp::PhaseAccumulator::advance(phase, wc);
+      dsp::PhaseAccumulator::advance(phasem, wm);
+    }
+    if (ramp)
+      for (int j = 0; j <= 2*N; j++) c[j] = c1[j];
+  }
+  v.phase[0] = phase;
+  v.phase[1] = phasem;
+}
+
+typedef void (*bessel_fn)(Voice &, q31_t *, uint32_t, float, float, float,
+                          float, IndexRamp &, int, int);
+
+// indexed by sideband count - 1
+const bessel_fn bessel_renderers[k_exmodfm_nside] = {
+  render_bessel<1>, render_bessel<2>, render_bessel<3>
+};
+
+typedef void (*render_fn)(Voice &, q31_t *, uint32_t, float, float, float,
+                          float, IndexRamp &);
+
+// indexed by (r != 0)*2 + (s != 0)
+const render_fn renderers[] = {
+  render<false, false>, render<false, true>,
+  render<true, false>, render<true, true>
+};
+
+#if EXMODFM_UNISON > 1
+// unison: the copies share the envelope and index ramp, which
+// are computed once per frame, and are mixed at 1/count to stay
+// under full scale. The loop over copies is scalar: the kernel's
+// table lookups gather, and the M4 FPU has no float SIMD
+template<bool R, bool S>
+void render_unison(Voice &v, q31_t *__restrict y, uint32_t frames,
+                   float wc, float wm, float r, float s, IndexRamp &ix) {
+  dsp::ADSREnvelope &env = v.env;
+  const int nu = obj.nuni;
+  const float g = 1.f / nu;
+  float pc[EXMODFM_UNISON], pm[EXMODFM_UNISON];
+  float wcu[EXMODFM_UNISON], wmu[EXMODFM_UNISON];
+
+  for (int j = 0; j < nu; j++) {
+    pc[j] = v.uc[j];
+    pm[j] = v.um[j];
+    wcu[j] = wc*obj.uratio[j];
+    wmu[j] = wm*obj.uratio[j];
+  }
+  for (uint32_t n = 0; n < frames; n += k_exmodfm_subblock) {
+    const uint32_t len = frames - n < k_exmodfm_subblock ?
+      frames - n : k_exmodfm_subblock;
+    float m = ix.m;
+    const float dm = ix.step(env, len);
+    for (uint32_t i = n; i < n + len; i++) {
+      m += dm;
+      float acc = 0.f;
+      for (int j = 0; j < nu; j++) {
+        acc += obj.synthesise<R,S>(m,r,s,pc[j],pm[j]);
+        dsp::PhaseAccumulator::advance(pc[j], wcu[j]);
+        dsp::PhaseAccumulator::advance(pm[j], wmu[j]);
+      }
+      const float sig = g*acc;
+      y[i] = f32_to_q31(sig);
+      r += ix.dr;
+      s += ix.ds;
+    }
+  }
+  for (int j = 0; j < nu; j++) {
+    v.uc[j] = pc[j];
+    v.um[j] = pm[j];
+  }
+}
+
+const render_fn unison_renderers[] = {
+  render_unison<false, false>, render_unison<false, true>,
+  render_unison<true, false>, render_unison<true, true>
+};
+#endif
+
+#if k_exmodfm_fixed_path
+// fixed-point path, for the pair and its unison copies: 32-bit
+// phases and q15 tables interpolated with SMUAD, the copies mixed
+// two at a time with SMLALD. The index times r log2(e) and s / 2 pi
+// ramp as q16.16 between breakpoints; the table resolution (about
+// -90 dB) holds up at low index, where the kernel is smooth
+void render_fixed(Voice &v, q31_t *__restrict y, uint32_t frames,
+                  float wc, float wm, float r, float s, IndexRamp &ix) {
+  typedef dsp::FixedModFM Fx;
+  dsp::ADSREnvelope &env = v.env;
+#if EXMODFM_UNISON > 1
+  const int nu = obj.nuni;
+  float *uc = nu > 1 ? v.uc : v.phase, *um = nu > 1 ? v.um : v.phase + 1;
+#else
+  const int nu = 1;
+  float *uc = v.phase, *um = v.phase + 1;
+#endif
+  uint32_t pc[EXMODFM_UNISON], pm[EXMODFM_UNISON];
+  uint32_t wcu[EXMODFM_UNISON], wmu[EXMODFM_UNISON];
+  // output gain, the operator level over the copy count, q15
+  const q31_t g = (q31_t) (obj.g0 / nu * 32768.f);
+
+  for (int j = 0; j < nu; j++) {
+#if EXMODFM_UNISON > 1
+    const float ur = nu > 1 ? obj.uratio[j] : 1.f;
+#else
+    const float ur = 1.f;
+#endif
+    pc[j] = Fx::phase(uc[j]);
+    pm[j] = Fx::phase(um[j]);
+    wcu[j] = Fx::phase(wc*ur);
+    wmu[j] = Fx::phase(wm*ur);
+  }
+  for (uint32_t n = 0; n < frames; n += k_exmodfm_subblock) {
+    const uint32_t len = frames - n < k_exmodfm_subblock ?
+      frames - n : k_exmodfm_subblock;
+    const float len1 = 65536.f / len;
+    const float m0 = ix.m;
+    ix.step(env, len);
+    const float r1 = r + ix.dr*len, s1 = s + ix.ds*len;
+    const float kl0 = r*m0*1.442695041f, sk0 = s*m0*ONEOPI2;
+    q15_16_t kl = (q15_16_t) (kl0*65536.f), sk = (q15_16_t) (sk0*65536.f);
+    const q15_16_t dkl = (q15_16_t) ((r1*ix.m*1.442695041f - kl0)*len1);
+    const q15_16_t dsk = (q15_16_t) ((s1*ix.m*ONEOPI2 - sk0)*len1);
+    for (uint32_t i = n; i < n + len; i++) {
+      kl += dkl;
+      sk += dsk;
+      q63_t acc = 0;
+      int j = 0;
+      for (; j + 1 < nu; j += 2) {
+        const q15_t a0 = Fx::amp(kl, Fx::cos(pm[j]));
+        const q15_t a1 = Fx::amp(kl, Fx::cos(pm[j+1]));
+        const q15_t c0 = Fx::carrier(pc[j], sk, Fx::sin(pm[j]));
+        const q15_t c1 = Fx::carrier(pc[j+1], sk, Fx::sin(pm[j+1]));
+        acc = smlald(pkhbt(a0, a1, 16), pkhbt(c0, c1, 16), acc);
+        pc[j] += wcu[j];
+        pm[j] += wmu[j];
+        pc[j+1] += wcu[j+1];
+        pm[j+1] += wmu[j+1];
+      }
+      if (j < nu) {
+        // the odd copy out
+        acc += (q31_t) Fx::amp(kl, Fx::cos(pm[j])) *
+          Fx::carrier(pc[j], sk, Fx::sin(pm[j]));
+        pc[j] += wcu[j];
+        pm[j] += wmu[j];
+      }
+      y[i] = (q31_t) ((acc * g) >> 14);
+    }
+    r = r1;
+    s = s1;
+  }
+  for (int j = 0; j < nu; j++) {
+    uc[j] = Fx::cycles(pc[j]);
+    um[j] = Fx::cycles(pm[j]);
+  }
+}
+#endif
+
+#if EXMODFM_NOPS > 2
+// N operator stack, rendered as block-wise passes from the top
+// operator down: w holds the operator increments and kx the
+// indices of operators 3 - N; the carrier/modulator link uses
+// r, s and the index ramp, as in the pair renderers
+template<int N, bool SERIES>
+void render_stack(Voice &v, q31_t *__restrict y, uint32_t frames,
+                  const float *w, const float *kx, float r, float s,
+                  IndexRamp &ix) {
+  dsp::ADSREnvelope &env = v.env;
+  const uint32_t ovs = obj.os ? 2 : 1;
+  float ph[N], wi[N];
+  float rm[2*k_exmodfm_subblock], sm[2*k_exmodfm_subblock];
+  float c[2*k_exmodfm_subblock], q[2*k_exmodfm_subblock];
+  float buf[2*k_exmodfm_subblock];
+
+  for (int j = 0; j < N; j++) {
+    ph[j] = v.phase[j];
+    wi[j] = w[j] / ovs;
+  }
+
+  for (uint32_t n = 0; n < frames; n += k_exmodfm_subblock) {
+    const uint32_t len = frames - n < k_exmodfm_subblock ?
+      frames - n : k_exmodfm_subblock;
+    const uint32_t ns = len*ovs;
+
+    // carrier/modulator index times r and s, at the output rate
+    float mi = ix.m;
+    const float dm = ix.step(env, len);
+    for (uint32_t i = 0; i < ns; i += ovs) {
+      mi += dm;
+      rm[i] = rm[i+ovs-1] = r*mi;
+      sm[i] = sm[i+ovs-1] = s*mi;
+      r += ix.dr;
+      s += ix.ds;
+    }
+
+    if (SERIES) {
+      // top operator, free running
+      for (uint32_t i = 0; i < ns; i++) {
+        const f32pair_t sc = Math::sincos(ph[N-1]);
+        c[i] = sc.b;
+        q[i] = sc.a;
+        dsp::PhaseAccumulator::advance(ph[N-1], wi[N-1]);
+      }
+      // operators N-2 to 1, each modulated by the one above,
+      // passing on its quadrature pair scaled by its amplitude
+      // (normalised by g0, so a zero index leaves it at 1)
+      const float g1 = 1.f / obj.g0;
+      for (int j = N-2; j > 0; j--) {
+        const float k = kx[j+1], rk = obj.xop[j-1].r*k;
+        const float sk = obj.xop[j-1].s*k*ONEOPI2;
+        for (uint32_t i = 0; i < ns; i++) {
+          const float a = g1*ModFMOp::amp(rk, c[i]);
+          const f32pair_t sc =
+            Math::sincos(dsp::PhaseAccumulator::wrap(ph[j] + sk*q[i]));
+          c[i] = a*sc.b;
+          q[i] = a*sc.a;
+          dsp::PhaseAccumulator::advance(ph[j], wi[j]);
+        }
+      }
+      // carrier
+      for (uint32_t i = 0; i < ns; i++) {
+        const float p =
+          dsp::PhaseAccumulator::wrap(ph[0] + sm[i]*ONEOPI2*q[i]);
+        buf[i] = ModFMOp::amp(rm[i], c[i])*Math::cos(p);
+        dsp::PhaseAccumulator::advance(ph[0], wi[0]);
+      }
+    } else {
+      // operators 3 - N accumulate a phase offset in q and
+      // a log amplitude in c, so one exp serves them all
+      for (uint32_t i = 0; i < ns; i++) c[i] = q[i] = 0.f;
+      for (int j = 2; j < N; j++) {
+        const float k = kx[j], rk = obj.xop[j-2].r*k;
+        const float sk = obj.xop[j-2].s*k*ONEOPI2;
+        for (uint32_t i = 0; i < ns; i++) {
+          const f32pair_t sc = Math::sincos(ph[j]);
+          c[i] += rk*(sc.b-1.f);
+          q[i] += sk*sc.a;
+          dsp::PhaseAccumulator::advance(ph[j], wi[j]);
+        }
+      }
+      // carrier and modulator
+      for (uint32_t i = 0; i < ns; i++) {
+        const f32pair_t sc = Math::sincos(ph[1]);
+        const float p =
+          dsp::PhaseAccumulator::wrap(ph[0] + sm[i]*ONEOPI2*sc.a + q[i]);
+        buf[i] = ModFMOp::exp(rm[i]*(sc.b-1.f) + c[i])*Math::cos(p);
+        dsp::PhaseAccumulator::advance(ph[0], wi[0]);
+        dsp::PhaseAccumulator::advance(ph[1], wi[1]);
+      }
+    }
+
+    OSC_PROF_BEGIN(dec, "decimate");
+    if (ovs == 2) v.hb.process(buf, buf, len);
+    for (uint32_t i = 0; i < len; i++)
+      y[n+i] = f32_to_q31(clipminmaxf(-1.f, buf[i], k_exmodfm_clip));
+    OSC_PROF_END(dec, len);
+  }
+
+  for (int j = 0; j < N; j++) v.phase[j] = ph[j];
+}
+
+typedef void (*stack_fn)(Voice &, q31_t *, uint32_t, const float *,
+                         const float *, float, float, IndexRamp &);
+
+// indexed by algorithm and operator count - 3
+const stack_fn stack_renderers[][EXMODFM_NOPS - 2] = {
+  { render_stack<3, true>,
+#if EXMODFM_NOPS > 3
+    render_stack<4, true>,
+#endif
+  },
+  { render_stack<3, false>,
+#if EXMODFM_NOPS > 3
+    render_stack<4, false>,
+#endif
+  }
+};
+#endif
+
+// render frames of voice v, with the static and LFO part of
+// the index and the shape weights following kr; w and kx hold
+// the operator increments and the indices of operators 3 - N,
+// kmax the carrier/modulator index limit
+static void render_voice(Voice &v, q31_t *y, uint32_t frames,
+                         const float *w, const float *kx, float kmax,
+                         const KernelRamp &kr) {
+  const float wc = w[0], wm = w[1];
+  const float amnt = obj.amnt.val()*MODMAX;
+  const float r = kr.r, r1 = r + kr.dr*frames;
+  const float s = kr.s, s1 = s + kr.ds*frames;
+  // kernel chosen once per block, for r and s at either end
+  const int kern = (r != 0.f || r1 != 0.f)*2 + (s != 0.f || s1 != 0.f);
+#if EXMODFM_UNISON > 1
+  const bool unison = obj.nuni > 1;
+#else
+  const bool unison = false;
+#endif
+  IndexRamp ix(amnt, kr, kmax, v.env.val());
+
+#if EXMODFM_NOPS > 2
+  if (obj.nops > 2) {
+    OSC_PROF_COUNT("path stack", frames);
+    stack_renderers[obj.alg][obj.nops - 3](v, y, frames, w, kx, r, s, ix);
+  } else
+#endif
+#if k_exmodfm_fixed_path
+  if (obj.fixed && !obj.os) {
+    OSC_PROF_COUNT("path fixed", frames);
+    render_fixed(v, y, frames, wc, wm, r, s, ix);
+  } else
+#endif
+  if (obj.bessel && !obj.os && !unison) {
+    // upper bound of the index over the block
+    const float k1 = kr.k + kr.dk*frames;
+    float mmax = amnt*v.env.peak(frames) + (kr.k > k1 ? kr.k : k1);
+    mmax = mmax < kmax ? mmax : kmax;
+    const float g = mmax*fmaxf(fmaxf(fabsf(r), fabsf(r1)),
+                               fmaxf(fabsf(s), fabsf(s1)));
+    if (g < k_exmodfm_bessel_max) {
+      // sideband count: the first one left out, of order
+      // g^(N+1)/(N+1)!, under tolerance
+      int N = 1;
+      for (float t = g*g*0.5f; N < k_exmodfm_nside &&
+             t >= k_exmodfm_bessel_tol; N++)
+        t *= g / (N + 2);
+      // and within +/- Nyquist
+      const int nhi = (int) ceilf((0.5f - wc)/wm) - 1;
+      const int nlo = (int) floorf((-0.5f - wc)/wm) + 1;
+      OSC_PROF_COUNT("path bessel", frames);
+      bessel_renderers[N-1](v, y, frames, wc, wm, r, s, ix,
+                            nlo > -N ? nlo : -N, nhi < N ? nhi : N);
+    } else {
+      OSC_PROF_COUNT("path kernel", frames);
+      renderers[kern](v, y, frames, wc, wm, r, s, ix);
+    }
+  } else
+#if EXMODFM_UNISON > 1
+  if (obj.nuni > 1 && !obj.os) {
+    OSC_PROF_COUNT("path unison", frames);
+    unison_renderers[kern](v, y, frames, wc, wm, r, s, ix);
+  } else
+#endif
+  {
+    OSC_PROF_COUNT("path kernel", frames);
+    renderers[kern](v, y, frames, wc, wm, r, s, ix);
+  }
+}
+
+void OSC_INIT(uint32_t platform, uint32_t api) {
+  Math::init();
+  obj.xfade = k_exmodfm_xfade * k_samplerate / 48000;
+  obj.xfinc = 1.f / obj.xfade;
+#if k_exmodfm_fixed_path
+  dsp::FixedModFM::init();
+#endif
+}
+
+void OSC_CYCLE(const user_osc_param_t *const params, int32_t *yn,
+               const uint32_t frames) {
+  OSC_PROF_BEGIN(derive, "derive");
+  // r and s ramp over the block to their values for shape
+  // and shift-shape at its end
+  KernelRamp kr;
+  kr.r = obj.r;
+  kr.s = obj.s;
+  const float dshape = obj.shape.step(frames);
+  const float dshift = obj.shift.step(frames);
+  if (dshape != 0.f || dshift != 0.f) obj.set_shape();
+  if (!obj.smooth) {
+    kr.r = obj.r;
+    kr.s = obj.s;
+  }
+  const float frameo1 = 1.f / frames;
+  kr.dr = (obj.r - kr.r)*frameo1;
+  kr.ds = (obj.s - kr.s)*frameo1;
+  obj.amnt.step(frames);
+  obj.fine.step(frames);
+  const float w0 = osc_w0f_for_note((params->pitch) >> 8, params->pitch & 0xFF);
+  const float wc = w0*obj.car;
+  const float wm = w0*obj.mod*obj.fine.val();
+  // limited for the larger weights over the block
+  const float r = fmaxf(fabsf(kr.r), fabsf(obj.r));
+  const float s = fmaxf(fabsf(kr.s), fabsf(obj.s));
+  // oversampled, sidebands up to 3/4 of the internal rate
+  // fold back into the decimator stopband
+#if EXMODFM_UNISON > 1
+  // limited for the highest unison copy
+  const float wu = obj.nuni > 1 && !obj.os ? obj.uratio[obj.nuni-1] : 1.f;
+#else
+  const float wu = 1.f;
+#endif
+  const float kmax = !obj.limit ? MODMAX :
+    (obj.os ? obj.max_index(0.5f*wc, 0.5f*wm, r, s, 0.75f) :
+     obj.max_index(wu*wc, wu*wm, r, s, 0.5f));
+  const float lfo = fabs(q31_to_f32(params->shape_lfo))*MODMAX;
+  // static index and LFO ramp over the block, held from a note-on
+  if (obj.reset)
+    obj.koff.reset(obj.ndx*MODMAX + lfo);
+  else
+    obj.koff.set(obj.ndx*MODMAX + lfo, frames);
+  kr.k = obj.koff.val();
+  kr.dk = obj.koff.step(frames);
+  q31_t *y = (q31_t *) yn;
+
+  float w[EXMODFM_NOPS], kx[EXMODFM_NOPS];
+  w[0] = wc;
+  w[1] = wm;
+#if EXMODFM_NOPS > 2
+  // operators 3 - N, limited against their targets
+  const float osf = obj.os ? 0.5f : 1.f;
+  for (int j = 2; j < obj.nops; j++) {
+    const ExtOp &op = obj.xop[j-2];
+    const float wt = obj.alg == k_exmodfm_alg_series ? w[j-1] : wc;
+    w[j] = w0*op.ratio;
+    kx[j] = op.ndx*MODMAX;
+    if (obj.limit) {
+      const float km = obj.max_index(osf*wt, osf*w[j], op.r, op.s,
+                                     obj.os ? 0.75f : 0.5f);
+      kx[j] = kx[j] < km ? kx[j] : km;
+    }
+  }
+#endif
+  OSC_PROF_END(derive, 0);
+
+  // voice rendering, decimation included
+  OSC_PROF_BEGIN(synth, "synth");
+  uint32_t start = 0;
+  if (obj.reset) {
+    // the sounding note runs up to the first frame at or past
+    // the note-on, where the new one starts with its phases
+    // advanced by the fraction of a frame in between
+    const uint32_t ofs = obj.ofs < (frames << 8) ? obj.ofs : frames << 8;
+    start = (ofs + 255) >> 8;
+    if (start) render_voice(obj.v, y, start, w, kx, kmax, kr);
+    // an audible note is kept for a crossfade
+    if (obj.v.env.val() > 0.f) {
+      obj.tail = obj.v;
+      obj.xf = obj.xfade;
+    }
+    const float frac = ((start << 8) - ofs) * (1.f / 256.f);
+    for (int j = 0; j < EXMODFM_NOPS; j++) obj.v.phase[j] = frac*w[j];
+#if EXMODFM_UNISON > 1
+    for (int j = 0; j < obj.nuni; j++) {
+      obj.v.uc[j] =
+        dsp::PhaseAccumulator::wrap(PSModFM::uphase(j) + frac*wc*obj.uratio[j]);
+      obj.v.um[j] = frac*wm*obj.uratio[j];
+    }
+#endif
+    obj.v.env = obj.nenv;
+    obj.v.hb.flush();
+  }
+  render_voice(obj.v, y + start, frames - start, w, kx, kmax,
+               kr.from(start));
+  OSC_PROF_END(synth, frames);
+
+  if (obj.xf) {
+    // old note fading out, new one fading in, over
+    // obj.xfade frames from the note-on
+    q31_t t[k_exmodfm_maxframes];
+    const uint32_t len = frames - start < obj.xf ? frames - start : obj.xf;
+    OSC_PROF_SCOPE("xfade", len);
+    const float ginc = obj.xfinc;
+    float g = (obj.xfade - obj.xf)*ginc;
+    render_voice(obj.tail, t, len, w, kx, kmax, kr.from(start));
+    for (uint32_t i = 0; i < len; i++) {
+      const float a = q31_to_f32(y[start+i]), b = q31_to_f32(t[i]);
+      y[start+i] = f32_to_q31(b + g*(a - b));
+      g += ginc;
+    }
+    obj.xf -= len;
+  }
+  obj.reset = 0;
+  if (!obj.smooth) obj.start_smoothing();
+}
+
+void OSC_NOTEON(const user_osc_param_t *const params) {
+  const float att = Math::pow(11.f, obj.att) - 1.f;
+  const float dcy = Math::pow(11.f, obj.dcy) - 1.f;
+  const float rel = Math::pow(11.f, obj.rel) - 1.f;
+  obj.nenv.init(att, dcy, obj.sus, rel, obj.map == k_exmodfm_map_rs);
+  obj.ofs = osc_noteon_offset(params);
+  obj.reset = 1;
+}
+
+void OSC_NOTEOFF(const user_osc_param_t *const params) {
+  obj.v.env.release();
+  obj.nenv.release();
+}
+
+void OSC_PARAM(uint16_t index, uint16_t value) {
+  const float valf = param_val_to_f32(value);
+  switch (index) {
+  case k_user_osc_param_id1:
+    // car ratio (0 - 9), plus 10 for the r/s mapping
+    obj.car = (float)  (value % 10 + 1);
+    if (obj.map != value / 10) {
+      obj.map = value / 10;
+      obj.set_shape();
+    }
+    break;
+  case k_user_osc_param_id2:
+    // mod ratio
+    obj.mod =  (float)  (value + 1);
+    break;
+  case k_user_osc_param_id3:
+    // mod fine
+    obj.fine.set(1.f + clip01f(value * 0.01f));
+    break;
+  case k_user_osc_param_id4:
+    // env att
+    obj.att = clip01f(value * 0.01f);
+    break;
+  case k_user_osc_param_id5:
+    // env release
+    obj.rel = clip01f(value * 0.01f);
+    break;
+  case k_user_osc_param_id6:
+    // env amount
+    obj.amnt.set(clip01f(value * 0.01f));
+    break;
+  case k_user_osc_param_shape:
+    obj.shape.set(valf);
+    break;
+  case k_user_osc_param_shiftshape:
+    obj.shift.set(valf);
+    break;
+  case k_exmodfm_param_limit:
+    obj.limit = value != 0;
+    break;
+  case k_exmodfm_param_os:
+    obj.os = value != 0;
+    break;
+  case k_exmodfm_param_nops:
+    obj.nops = value < 2 ? 2 : (value > EXMODFM_NOPS ? EXMODFM_NOPS : value);
+    break;
+  case k_exmodfm_param_bessel:
+    obj.bessel = value != 0;
+    break;
+#if EXMODFM_UNISON > 1
+  case k_exmodfm_param_unison:
+    obj.nuni = value < 1 ? 1 :
+      (value > EXMODFM_UNISON ? EXMODFM_UNISON : value);
+    obj.set_unison();
+    break;
+  case k_exmodfm_param_detune:
+    obj.detune = value > 100 ? 100.f : (float) value;
+    obj.set_unison();
+    break;
+#endif
+  case k_exmodfm_param_fixed:
+    obj.fixed = value != 0;
+    break;
+  case k_exmodfm_param_decay:
+    obj.dcy = clip01f(value * 0.01f);
+    break;
+  case k_exmodfm_param_sustain:
+    obj.sus = clip01f(value * 0.01f);
+    break;
+  case k_exmodfm_param_alg:
+    obj.alg = value ? k_exmodfm_alg_parallel : k_exmodfm_alg_series;
+    break;
+  default:
+    if (index >= k_exmodfm_param_op && index <= k_exmodfm_param_op_last) {
+      // ratio (0 - 9), r (0 - 100%), s (-100 - 100%, offset by 100)
+      // and index (0 - 100%)
+      ExtOp &op = obj.xop[(index - k_exmodfm_param_op) / 4];
+      switch ((index - k_exmodfm_param_op) % 4) {
+      case 0:
+        op.ratio = (float) (value + 1);
+        break;
+      case 1:
+        op.r = PSModFM::snap(clip01f(value * 0.01f));
+        break;
+      case 2:
+        op.s = PSModFM::snap(clipminmaxf(-1.f, (value - 100) * 0.01f, 1.f));
+        break;
+      default:
+        op.ndx = clip01f(value * 0.01f);
+        break;
+      }
+    }
+    break;
+  }
+}
@@ -0,0 +1,31 @@
+# #############################################################################
+# Project Customization
+# #############################################################################
+
+PROJECT = exmodfm
+
+UCSRC =
+
+UCXXSRC = exmodfm.cpp
+
+UINCDIR =
+
+# Pitch-dependent index limiting is disabled with -DEXMODFM_LIMIT=0
+# 2x oversampled rendering is enabled with -DEXMODFM_OVERSAMPLE=1
+# Operators (2 - 4, default 2) can be set with -DEXMODFM_NOPS=n
+# The additive low-index path is enabled with -DEXMODFM_BESSEL=1
+# Unison copies (1 - 8, default 1) are set with -DEXMODFM_UNISON=n and their
+# detune, in cents, with -DEXMODFM_DETUNE=c (default 20)
+# The fixed-point pair and unison kernel is enabled with -DEXMODFM_FIXED=1
+# Math approximations (Fast, Faster, Table or Reference, default Faster)
+# can be set with -DMODFM_MATH=name
+# The 1024-point sine table, in unit SRAM, is used with -DMODFM_SINE=Full
+# The envelope decay time and sustain level (0 - 100%, defaults 0 and 100)
+# are set with -DMODFM_ENV_DECAY=n and -DMODFM_ENV_SUSTAIN=n
+# Hook calls are logged for the host replayer with -DOSC_TRACE (see
+# host/README.md), into OSC_TRACE_SIZE bytes (default 4096)
+UDEFS =
+
+ULIB = 
+
+ULIBDIR =
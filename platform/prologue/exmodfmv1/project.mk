@@ -1,17 +0,0 @@
-# #############################################################################
-# Project Customization
-# #############################################################################
-
-PROJECT = exmodfm1
-
-UCSRC =
-
-UCXXSRC = exmodfm.cpp
-
-UINCDIR =
-
-UDEFS =
-
-ULIB = 
-
-ULIBDIR =
@@ -1,17 +0,0 @@
-# #############################################################################
-# Project Customization
-# #############################################################################
-
-PROJECT = exmodfm2
-
-UCSRC =
-
-UCXXSRC = exmodfm.cpp
-
-UINCDIR =
-
-UDEFS =
-
-ULIB = 
-
-ULIBDIR =
@@ -17,9 +17,24 @@
 
 
 #include "userosc.h"
-#define EXP(x) fasterexpf(x)
-#define POW(x, y) fasterpowf(x, y)
-#define POW2(x) fasterpow2f(x)
+#include "modfm.hpp"
+#include "smoother.hpp"
+#include "formantset.h"
+#include "osc_prof.h"
+#ifdef OSC_HOST
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "osc_host.h"
+#endif
+#ifdef FORMANT_USER_SET
+// defines formant_user_set[], see tools/fsetc.py
+#include FORMANT_USER_SET
+#endif
+
+typedef dsp::UnitMath Math;
+typedef dsp::ModFMOperator<Math> ModFMOp;
 
 /* bass formants */
 const float bassf[] = {600,400,250,400,350,600,
@@ -93,145 +108,412 @@ const float *bws[] = {(const float *) bassb, (const float *) tenorb,
 const float *amp[] = {(const float *) bassa, (const float *) tenora,
                       (const float *) altoa,  (const float *) sopra}; 
 
+// SATB split points
+const uint8_t sp1[] = {54, 52, 50, 48};
+const uint8_t sp2[] = {64, 62, 60, 58};
+const uint8_t sp3[] = {74, 72, 70, 68};
 
-// Simple linear AR envelope
-struct Env {
-  float atti, deci, e;
-  bool dflg;
 
-  Env() : atti(1), deci(1), e(0.), dflg(false) { };
+// envelope control period (samples)
+#define k_formant_subblock (16)
 
-  float init(float att, float dec) {
-    e = 0.f;
-    atti = att > 0.f ? 1.f / (att * k_samplerate) : (e = 1.f);
-    deci = dec > 0.f ? 1.f / (dec * k_samplerate) : 1.f;
-    dflg = false;
+// default aspiration amount (%), settable at run time on the host only
+#ifndef FORMANT_BREATH
+#define FORMANT_BREATH (0)
+#endif
+
+// Low-passed white noise, generated a block at a time
+struct Noise {
+  uint32_t x[4];
+  float z, pole, gain;
+
+  Noise() : z(0.f), pole(0.f), gain(0.f) { seed(1); };
+
+  // four interleaved lanes of one LCG sequence,
+  // each lane stepping four places at a time
+  void seed(uint32_t s) {
+    for (int j = 0; j < 4; j++)
+      x[j] = s = s * 1664525U + 1013904223U;
   }
 
-  void decay() { dflg = true; }
+  // cutoff w in cycles/sample; gain sets the output RMS to 1/2
+  void set(float w) {
+    pole = clipminmaxf(0.f, 1.f - M_TWOPI * w, 0.999f);
+    gain = .5f * sqrtf(3.f * (1.f + pole) / (1.f - pole));
+  }
 
-  float proc() {
-    return (e = !dflg ? (e < 1.f ? e + atti : 1.f)
-            : (e > 0.f ? e - deci : 0.f));
+  // n samples, n a multiple of 4, clipped to [-1, 1]
+  void block(float *out, int n) {
+    const uint32_t a4 = 1664525U * 1664525U * 1664525U * 1664525U;
+    const uint32_t c4 = 1013904223U *
+      (1U + 1664525U * (1U + 1664525U * (1U + 1664525U)));
+    for (int i = 0; i < n; i += 4) {
+      for (int j = 0; j < 4; j++) {
+        out[i + j] = (int32_t) x[j] * 4.656612873e-10f;
+        x[j] = x[j] * a4 + c4;
+      }
+    }
+    float y = z;
+    const float g = (1.f - pole) * gain;
+    for (int i = 0; i < n; i++) {
+      y = out[i] * g + pole * y;
+      out[i] = clip1m1f(y);
+    }
+    z = y;
   }
+};
 
-  float val() { return e;}
+// Formant parameters, derived from the vowel tables and
+// latched by the renderer
+struct FormantRecord {
+  int nform;
+  float ff[FORMANT_NMAX];   // formant frequencies (harmonics)
+  float ndx[FORMANT_NMAX];  // modulation indices
+  float amps[FORMANT_NMAX]; // amplitudes
 };
 
+// pitch-synchronous mode default, settable at run time on the host only
+#ifndef FORMANT_PSYNC
+#define FORMANT_PSYNC (0)
+#endif
+
+// time constant of the shape, shift-shape and menu parameters (s)
+#define k_formant_smooth (0.01f)
+
+typedef dsp::Smoother<dsp::k_smooth_onepole> ParamSmoother;
+
 struct PSModFM {
-  float phase, sphase;
-  float shft;
+  dsp::PhaseAccumulator ph, sph;
+  // shift and env amount, smoothed at block rate; vowel,
+  // offset and the shape LFO, reaching the formants a
+  // sub-block at a time
+  ParamSmoother shft, amnt;
+  ParamSmoother form, offset;
+  dsp::Smoother<dsp::k_smooth_linear> lfo;
   int16_t smax;
   int16_t fno;
-  float att, dec, amnt;
-  float form;
-  float offset;
-  Env env;
+  int16_t nform;
+  // envelope attack, decay and release (0 - 1, as 0 - 10 s)
+  // and sustain level
+  float att, dcy, sus, rel;
+  float breath;
+  bool psync, latched, smooth;
+  FormantRecord rec;
+  dsp::ADSREnvelope env;
+  Noise noise;
+  FormantSets sets;
+
+  PSModFM() :  ph(), sph(), shft(), amnt(), form(), offset(), lfo(),
+               smax(0), fno(0), nform(FORMANT_NMAX), att(0.f),
+               dcy(MODFM_ENV_DECAY * 0.01f), sus(MODFM_ENV_SUSTAIN * 0.01f),
+               rel(0.f),
+               breath(FORMANT_BREATH * 0.01f), psync(FORMANT_PSYNC),
+               latched(false), smooth(false), env(), noise(), sets() { };
+
+  // parameters set before the first block, with no smoothing
+  // time yet, take effect at once
+  void start_smoothing() {
+    smooth = true;
+    shft.time(k_formant_smooth);
+    amnt.time(k_formant_smooth);
+    form.time(k_formant_smooth);
+    offset.time(k_formant_smooth);
+  }
 
-  PSModFM() :  phase(0.f), sphase(0.f),shft(0.f), smax(0), fno(0), att(0.f),
-               dec(0.f),amnt(0.f), form(0.f), offset(0.f), env() { };
-    
+  // advance the vowel, offset and LFO n frames, returning
+  // whether any of them moved
+  bool step(uint32_t n) {
+    const float df = form.step(n), doffs = offset.step(n);
+    const float dlfo = lfo.step(n);
+    return df != 0.f || doffs != 0.f || dlfo != 0.f;
+  }
 
-  float formant(float ndx, float ff, float phase, float sphase, float mod) {
-    const int m =  (uint32_t) ff;
-    const float a = ff - m;
-    float pc1 = phase * m + sphase;
-    float pc2 = phase * (m + 1) + sphase;
-    pc1 -= (uint32_t) pc1;
-    pc2 -= (uint32_t) pc2; 
-    return (a * osc_cosf(pc2) + (1.f - a) * osc_cosf(pc1)) * EXP(ndx * (mod - 1.f));
+  // compile the built-in SATB tables into sets 0 - 7:
+  // single voices followed by the four splits
+  void init_sets() {
+    for (int i = 0; i < 4; i++)
+      sets.add_voice(frs[i], bws[i], amp[i], 5, 4, 6);
+    for (int i = 0; i < 4; i++) {
+      const uint8_t top = 128, voice = i;
+      sets.add_set(1, &top, &voice);
+    }
+    for (int i = 0; i < 4; i++) {
+      const uint8_t top[] = {sp1[i], sp2[i], sp3[i], 128};
+      const uint8_t voice[] = {0, 1, 2, 3};
+      sets.add_set(4, top, voice);
+    }
+#ifdef FORMANT_USER_SET
+    sets.load(formant_user_set, sizeof(formant_user_set));
+#endif
   }
 
-  float mod_ndx(float fo, float kbw) {
-    float g,gm;
-    g = POW2(-fo / (.29f * kbw));
-    gm = 1. - g;
-    return 2*g/(gm*gm);
+  // formant at harmonic m + a, with m integral and 0 <= a < 1
+  float formant(float ndx, float m, float a, float phase, float sphase,
+                float mod) {
+    const float pc1 = phase * m + sphase;
+    const float pc2 = pc1 + phase;
+    return ModFMOp::carrier(a, pc1, pc2) *
+      ModFMOp::amp(ndx, mod);
+  }
+
+  // derive the formant parameters for a note and fundamental
+  // frequency fo, at the current vowel, offset and LFO
+  void derive(FormantRecord &r, int note, float fo) {
+    const float fo1 = 1.f/fo;
+    const float offs = offset.val()*10.f;
+    const FormantVoice &voice = sets.voice(fno, note);
+    const int nvow = voice.nvow;
+    float frm = (lfo.val()+form.val())*nvow;
+
+    while(frm >= nvow) frm -= nvow;
+    while(frm < 0)  frm += nvow;
+    int n = (int) frm;
+    float frac = frm - n;
+    const FormantVowel &v0 = voice.vow[n];
+    const FormantVowel &v1 = voice.vow[n+1];
+
+    r.nform = voice.nform < nform ? voice.nform : nform;
+    for (int k = 0; k < r.nform; k++) {
+      const float bw = v0.bw[k] + frac*(v1.bw[k] - v0.bw[k]);
+      const float ff = v0.ff[k] + frac*(v1.ff[k] - v0.ff[k]);
+      r.amps[k] = v0.amp[k] + frac*(v1.amp[k] - v0.amp[k]);
+      r.ff[k] = ff < fo ? 1. : ff*fo1;
+      r.ndx[k] = ModFMOp::index(fo, bw) + offs;
+    }
   }
 };
 
 static PSModFM obj;
 
+// extended parameters, set by host builds only
+enum {
+  k_formant_param_nform = k_num_user_osc_param_id, // formant count limit
+  k_formant_param_breath,                          // aspiration amount
+  k_formant_param_psync,                           // pitch-synchronous mode
+  k_formant_param_decay,                           // envelope decay
+  k_formant_param_sustain                          // envelope sustain
+};
+
+// sum of K formants, unrolled at compile time;
+// each formant's harmonic m + a then moves by dm + da,
+// carrying a into m as it wraps, and its index and
+// amplitude by dn and dg
+template<int K>
+struct Formants {
+  static inline __attribute__((always_inline))
+  float sum(float *ndx, float *m, float *a, float *amps, const float *dm,
+            const float *da, const float *dn, const float *dg,
+            float phase, float sphase, float mod) {
+    const float s = Formants<K-1>::sum(ndx, m, a, amps, dm, da, dn, dg,
+                                       phase, sphase, mod) +
+      obj.formant(ndx[K-1], m[K-1], a[K-1], phase, sphase, mod)*amps[K-1];
+    const float ak = a[K-1] + da[K-1];
+    const float c = ak >= 1.f ? 1.f : 0.f;
+    a[K-1] = ak - c;
+    m[K-1] += dm[K-1] + c;
+    ndx[K-1] += dn[K-1];
+    amps[K-1] += dg[K-1];
+    return s;
+  }
+};
+
+template<>
+struct Formants<0> {
+  static inline __attribute__((always_inline))
+  float sum(float *ndx, float *m, float *a, float *amps, const float *dm,
+            const float *da, const float *dn, const float *dg,
+            float phase, float sphase, float mod) {
+    return 0.f;
+  }
+};
+
+// split a harmonic number or increment into integral and
+// fractional parts, with 0 <= fractional part < 1
+static inline void harm_split(float f, float &m, float &a) {
+  m = (float) (int32_t) f;
+  if (m > f) m -= 1.f;
+  a = f - m;
+}
+
+// render with N formants, for a note and fundamental fo; the
+// envelope scales the formant frequencies through per-sub-block
+// linear ramps, and the formants follow the vowel, offset and
+// LFO along them, derived again at each breakpoint where these
+// moved (but for the pitch-synchronous mode, which keeps r).
+// Aspiration modulates the formant carriers with low-passed
+// noise, mixed as (1 - breath) + breath * noise
+template<int N>
+void render(q31_t *__restrict y, uint32_t start, uint32_t end,
+            FormantRecord &r, int note, float fo, float w0, float ws,
+            float amnt) {
+  const float scale = 1.f / (N < 4 ? 4 : N);
+  const float gv = scale * (1.f - obj.breath);
+  const float gn = scale * obj.breath;
+  dsp::ADSREnvelope &env = obj.env;
+  dsp::PhaseAccumulator ph(obj.ph.mPhase, w0);
+  dsp::PhaseAccumulator sph(obj.sph.mPhase, ws);
+  float m[N], a[N], dm[N], da[N];
+  float ndx[N], amps[N], dn[N], dg[N];
+  float nz[k_formant_subblock] = {0};
+  float e = 1.f + amnt * env.val();
+
+  for (int k = 0; k < N; k++) {
+    harm_split(r.ff[k]*e, m[k], a[k]);
+    ndx[k] = r.ndx[k];
+    amps[k] = r.amps[k];
+  }
+
+  for (uint32_t i = start; i < end; ) {
+    const uint32_t len =
+      end - i < k_formant_subblock ? end - i : k_formant_subblock;
+    const float len1 = 1.f / len;
+    if (obj.step(len) && !obj.psync) {
+      OSC_PROF_SCOPE("derive", 0);
+      obj.derive(r, note, fo);
+    }
+    OSC_PROF_BEGIN(env, "envelope");
+    e = 1.f + amnt * env.proc(len);
+    for (int k = 0; k < N; k++) {
+      harm_split((r.ff[k]*e - m[k] - a[k])*len1, dm[k], da[k]);
+      dn[k] = (r.ndx[k] - ndx[k])*len1;
+      dg[k] = (r.amps[k] - amps[k])*len1;
+    }
+    OSC_PROF_END(env, 0);
+    if (gn > 0.f) {
+      OSC_PROF_SCOPE("noise", len);
+      obj.noise.block(nz, (len + 3) & ~3);
+    }
+    OSC_PROF_BEGIN(synth, "synth");
+    for (uint32_t j = 0; j < len; i++, j++) {
+      const float phase = ph.process();
+      const float sphase = sph.process();
+      const float mod = Math::cos(phase);
+      y[i] = f32_to_q31((gv + gn*nz[j])*Formants<N>::sum(ndx, m, a, amps,
+                                                         dm, da, dn, dg,
+                                                         phase, sphase,
+                                                         mod));
+    }
+    OSC_PROF_END(synth, len);
+  }
+  obj.ph = ph;
+  obj.sph = sph;
+}
+
+typedef void (*render_fn)(q31_t *, uint32_t, uint32_t, FormantRecord &,
+                          int, float, float, float, float);
+
+// renderers for 1 - FORMANT_NMAX formants
+const render_fn renderers[] = {
+  render<1>,
+#if FORMANT_NMAX > 1
+  render<2>,
+#endif
+#if FORMANT_NMAX > 2
+  render<3>,
+#endif
+#if FORMANT_NMAX > 3
+  render<4>,
+#endif
+#if FORMANT_NMAX > 4
+  render<5>,
+#endif
+#if FORMANT_NMAX > 5
+  render<6>,
+#endif
+#if FORMANT_NMAX > 6
+  render<7>,
+#endif
+#if FORMANT_NMAX > 7
+  render<8>,
+#endif
+};
+
 void OSC_INIT(uint32_t platform, uint32_t api) {
+  Math::init();
+  obj.init_sets();
+  obj.noise.seed(osc_rand());
+}
+
+#ifdef OSC_HOST
+int osc_host_load(const char *path) {
+  struct stat st;
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) return -1;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return -1;
+  }
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return -1;
+  const int res = obj.sets.load((const uint8_t *) data, st.st_size);
+  munmap(data, st.st_size);
+  return res < 0 ? -1 : 0;
 }
+#endif
 
 void OSC_CYCLE(const user_osc_param_t *const params, int32_t *yn,
                const uint32_t frames) {
-  Env &env = obj.env;
-  const float offset = obj.offset*10.f;
-  const float amnt = obj.amnt*2.f;
-  const int16_t fno = obj.fno;
+  obj.shft.step(frames);
+  obj.amnt.step(frames);
+  const float amnt = obj.amnt.val()*2.f;
   const int note = (params->pitch) >> 8;
   const float w0 = osc_w0f_for_note((params->pitch) >> 8, params->pitch & 0xFF);
   const float fo = w0 * k_samplerate;
-  const float fo1 = 1.f/fo;
-  const float ws = w0 * obj.shft * (1 + obj.smax);
+  const float ws = w0 * obj.shft.val() * (1 + obj.smax);
   const float lfo = q31_to_f32(params->shape_lfo);
-  float ff[4], ndx[4], bw, amps[3];
-  float form = (lfo+obj.form)*5.f;
-
-  const int sp1[] = {54, 52, 50, 48};
-  const int sp2[] = {64, 62, 60, 58};
-  const int sp3[] = {74, 72, 70, 68};
-  
-  float *bandwidth = (float *) (fno < 4 ? bws[fno] :
-                                (note < sp1[fno-4] ? bws[0] :
-                                 (note < sp2[fno-4] ? bws[1] :
-                                  (note < sp3[fno-4] ? bws[2] : bws[3]))));
-  
-  float *frequency =  (float *) (fno < 4 ? frs[fno] :
-                                 (note < sp1[fno-4] ? frs[0] :
-                                  (note < sp2[fno-4] ? frs[1] :
-                                   (note < sp3[fno-4] ? frs[2] : frs[3]))));
-
-  float *amplitudes = (float *)  (fno < 4 ? amp[fno] :
-                                  (note < sp1[fno-4] ? amp[0] :
-                                   (note < sp2[fno-4] ? amp[1] :
-                                    (note < sp3[fno-4] ? amp[2] : amp[3]))));  
-
-  while(form >= 5.f) form -= 5.f;
-  while(form < 0)  form += 5.f;
-  int n = (int) form;
-  float frac = form - n;
-  
-  for (int k = 0; k < 4; k++) {
-    bw = bandwidth[k*6+n] + frac*(bandwidth[k*6+n+1] - bandwidth[k*6+n]);
-    ff[k] = frequency[k*6+n] + frac*(frequency[k*6+n+1] - frequency[k*6+n]);
-    if(k) amps[k-1] = amplitudes[(k-1)*6+n] +
-            frac*(amplitudes[(k-1)*6+n+1] - amplitudes[(k-1)*6+n]);
-    ff[k] = ff[k] < fo ? 1. : ff[k]*fo1;
-    float md = obj.mod_ndx(fo, bw);
-    ndx[k] = md+offset;
+  FormantRecord &r = obj.rec;
+  q31_t *y = (q31_t *) yn;
+
+  // the LFO ramps over the block; on the first, the vowel
+  // and offset start at their targets
+  if (obj.smooth)
+    obj.lfo.set(lfo, frames);
+  else {
+    obj.lfo.reset(lfo);
+    obj.form.reset(obj.form.target());
+    obj.offset.reset(obj.offset.target());
   }
- 
-  float phase = obj.phase;
-  float sphase = obj.sphase;
-  
-  for (int i = 0; i < frames; i++) {
-    q31_t *__restrict y = (q31_t *) yn;
-    float mod, e;
-    e = 1.f + amnt * env.proc();
-    mod = osc_cosf(phase);
-    y[i] = f32_to_q31(.25f*(obj.formant(ndx[0],ff[0]*e,phase,sphase,mod) +
-                            obj.formant(ndx[1],ff[1]*e,phase,sphase,mod)*amps[0] +
-                            obj.formant(ndx[2],ff[2]*e,phase,sphase,mod)*amps[1] +
-                            obj.formant(ndx[3],ff[3]*e,phase,sphase,mod)*amps[2]));
-    phase += w0;
-    phase -= (uint32_t) phase;
-    sphase += ws;
-    sphase -= (uint32_t) sphase;    
+  obj.noise.set(w0);
+  if (!obj.psync || !obj.latched) {
+    // for the pitch, and for the first block
+    {
+      OSC_PROF_SCOPE("derive", 0);
+      obj.derive(r, note, fo);
+    }
+    obj.latched = true;
+    renderers[r.nform-1](y, 0, frames, r, note, fo, w0, ws, amnt);
+  } else {
+    // pitch-synchronous: keep the current record up to the first
+    // fundamental phase wrap in this block, if any, then derive
+    // a new one; later wraps in the block are ignored, and blocks
+    // with no wrap skip the derivation
+    const float wrap = ceilf((1.f - obj.ph.mPhase) / w0);
+    const uint32_t iw = wrap < frames ? (uint32_t) wrap : frames;
+    if (iw > 0)
+      renderers[r.nform-1](y, 0, iw, r, note, fo, w0, ws, amnt);
+    if (iw < frames) {
+      {
+        OSC_PROF_SCOPE("derive", 0);
+        obj.derive(r, note, fo);
+      }
+      renderers[r.nform-1](y, iw, frames, r, note, fo, w0, ws, amnt);
+    }
   }
-  obj.phase = phase;
-  obj.sphase = sphase;
+  if (!obj.smooth) obj.start_smoothing();
 }
 
 void OSC_NOTEON(const user_osc_param_t *const params) {
-  const float att = POW(11.f, obj.att) - 1.f;
-  const float dec = POW(11.f, obj.dec) - 1.f;
-  obj.env.init(att, dec);
+  const float att = Math::pow(11.f, obj.att) - 1.f;
+  const float dcy = Math::pow(11.f, obj.dcy) - 1.f;
+  const float rel = Math::pow(11.f, obj.rel) - 1.f;
+  obj.env.init(att, dcy, obj.sus, rel);
+  // in pitch-synchronous mode, a new note derives its record
+  // in its first block, not at its first wrap
+  obj.latched = false;
 }
 
-void OSC_NOTEOFF(const user_osc_param_t *const params) { obj.env.decay(); }
+void OSC_NOTEOFF(const user_osc_param_t *const params) { obj.env.release(); }
 
 void OSC_PARAM(uint16_t index, uint16_t value) {
   const float valf = param_val_to_f32(value);
@@ -242,7 +524,7 @@ void OSC_PARAM(uint16_t index, uint16_t value) {
     break;
   case k_user_osc_param_id2:
     // mod freq shift
-    obj.shft = clip01f(value * 0.01f);
+    obj.shft.set(clip01f(value * 0.01f));
     break;
   case k_user_osc_param_id3:
     obj.fno = value;
@@ -252,19 +534,34 @@ void OSC_PARAM(uint16_t index, uint16_t value) {
     obj.att = clip01f(value * 0.01f);
     break;
   case k_user_osc_param_id5:
-    // env dec
-    obj.dec = clip01f(value * 0.01f);
+    // env release
+    obj.rel = clip01f(value * 0.01f);
     break;
   case k_user_osc_param_id6:
     // env amount
-    obj.amnt = clip01f(value * 0.01f);
+    obj.amnt.set(clip01f(value * 0.01f));
     break;
   case k_user_osc_param_shape:
     // formant freq (0-1)
-    obj.form = valf;
+    obj.form.set(valf);
     break;
   case k_user_osc_param_shiftshape:
-    obj.offset = valf;
+    obj.offset.set(valf);
+    break;
+  case k_formant_param_nform:
+    obj.nform = value < 1 ? 1 : (value > FORMANT_NMAX ? FORMANT_NMAX : value);
+    break;
+  case k_formant_param_breath:
+    obj.breath = clip01f(value * 0.01f);
+    break;
+  case k_formant_param_psync:
+    obj.psync = value != 0;
+    break;
+  case k_formant_param_decay:
+    obj.dcy = clip01f(value * 0.01f);
+    break;
+  case k_formant_param_sustain:
+    obj.sus = clip01f(value * 0.01f);
     break;
   default:
     break;
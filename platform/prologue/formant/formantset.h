@@ -0,0 +1,211 @@
+/*  Formant set tables
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __formantset_h
+#define __formantset_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+  Binary formant set format (all fields little endian)
+
+  header, 8 bytes:
+    char     magic[4]    "FSET"
+    uint8_t  version     k_fset_version
+    uint8_t  nvoices     number of voice records
+    uint8_t  nsets       number of set records
+    uint8_t  reserved
+
+  voice record, 2 + 6 * nvowels * nforms bytes:
+    uint8_t  nvowels     1 - k_fset_max_vowels
+    uint8_t  nforms      1 - k_fset_max_formants
+    then, vowel by vowel, formant by formant:
+    uint16_t freq        centre frequency (Hz)
+    uint16_t bw          bandwidth (Hz)
+    uint16_t amp         amplitude (1/32768 units)
+
+  set record, 1 + 2 * nzones bytes:
+    uint8_t  nzones      1 - k_fset_max_zones
+    then, zone by zone, in ascending note order:
+    uint8_t  top         zone applies to notes below top
+    uint8_t  voice       voice record index, local to the file
+
+  Files are produced by tools/fsetc.py.
+*/
+
+#define k_fset_version      (1)
+#define k_fset_header_size  (8)
+#define k_fset_max_formants (8)
+#define k_fset_max_vowels   (10)
+#define k_fset_max_voices   (8)
+#define k_fset_max_sets     (16)
+#define k_fset_max_zones    (4)
+
+// Formants kept at runtime; voices with more formants
+// are truncated when compiled
+#ifndef FORMANT_NMAX
+#ifdef OSC_HOST
+#define FORMANT_NMAX k_fset_max_formants
+#else
+#define FORMANT_NMAX (4)
+#endif
+#endif
+
+// Runtime layout: one record per vowel with the
+// parameters of all formants interleaved
+struct FormantVowel {
+  float ff[FORMANT_NMAX];
+  float bw[FORMANT_NMAX];
+  float amp[FORMANT_NMAX];
+};
+
+struct FormantVoice {
+  uint8_t nvow, nform;
+  // one extra vowel, a copy of the first, for wrap-around
+  FormantVowel vow[k_fset_max_vowels + 1];
+};
+
+struct FormantSplit {
+  uint8_t nzones;
+  uint8_t top[k_fset_max_zones];
+  uint8_t voice[k_fset_max_zones];
+};
+
+struct FormantSets {
+  uint8_t nvoices, nsets;
+  FormantVoice voices[k_fset_max_voices];
+  FormantSplit sets[k_fset_max_sets];
+
+  FormantSets() : nvoices(0), nsets(0) { };
+
+  // add a voice from column-major float tables:
+  // f[k*stride + v], b[k*stride + v], a[(k-1)*stride + v];
+  // the first formant has unit amplitude
+  int add_voice(const float *f, const float *b, const float *a,
+                int nvow, int nform, int stride) {
+    if (nvoices == k_fset_max_voices) return -1;
+    FormantVoice &voice = voices[nvoices];
+    voice.nvow = nvow;
+    voice.nform = nform < FORMANT_NMAX ? nform : FORMANT_NMAX;
+    for (int v = 0; v < nvow; v++) {
+      FormantVowel &vow = voice.vow[v];
+      for (int k = 0; k < FORMANT_NMAX; k++) {
+        const bool in = k < nform;
+        vow.ff[k] = in ? f[k*stride + v] : 0.f;
+        vow.bw[k] = in ? b[k*stride + v] : 1.f;
+        vow.amp[k] = in ? (k ? a[(k-1)*stride + v] : 1.f) : 0.f;
+      }
+    }
+    voice.vow[nvow] = voice.vow[0];
+    return nvoices++;
+  }
+
+  int add_set(int nzones, const uint8_t *top, const uint8_t *voice) {
+    if (nsets == k_fset_max_sets) return -1;
+    FormantSplit &s = sets[nsets];
+    s.nzones = nzones;
+    for (int z = 0; z < nzones; z++) {
+      s.top[z] = top[z];
+      s.voice[z] = voice[z];
+    }
+    return nsets++;
+  }
+
+  // compile a binary formant set into the runtime layout,
+  // appending to the existing voices and sets;
+  // returns the number of sets added, or -1 if the data is
+  // malformed or does not fit (nothing is added in that case)
+  int load(const uint8_t *data, size_t size) {
+    if (size < k_fset_header_size || data[0] != 'F' || data[1] != 'S' ||
+        data[2] != 'E' || data[3] != 'T' || data[4] != k_fset_version)
+      return -1;
+    const int nv = data[5], ns = data[6];
+    if (nvoices + nv > k_fset_max_voices || nsets + ns > k_fset_max_sets)
+      return -1;
+    const uint8_t *p = data + k_fset_header_size;
+    const uint8_t *end = data + size;
+    const uint8_t nvoices0 = nvoices, nsets0 = nsets;
+
+    for (int i = 0; i < nv; i++) {
+      if (end - p < 2) break;
+      const int nvow = p[0], nform = p[1];
+      p += 2;
+      if (nvow < 1 || nvow > k_fset_max_vowels ||
+          nform < 1 || nform > k_fset_max_formants ||
+          end - p < 6 * nvow * nform) break;
+      FormantVoice &voice = voices[nvoices];
+      voice.nvow = nvow;
+      voice.nform = nform < FORMANT_NMAX ? nform : FORMANT_NMAX;
+      for (int v = 0; v < nvow; v++) {
+        FormantVowel &vow = voice.vow[v];
+        for (int k = 0; k < FORMANT_NMAX; k++) {
+          if (k < nform) {
+            vow.ff[k] = rd16(p + 6*k);
+            vow.bw[k] = rd16(p + 6*k + 2);
+            vow.amp[k] = rd16(p + 6*k + 4) * (1.f / 32768.f);
+          } else {
+            vow.ff[k] = vow.amp[k] = 0.f;
+            vow.bw[k] = 1.f;
+          }
+          if (vow.bw[k] < 1.f) vow.bw[k] = 1.f;
+        }
+        p += 6 * nform;
+      }
+      voice.vow[nvow] = voice.vow[0];
+      nvoices++;
+    }
+
+    for (int i = 0; i < ns && nvoices == nvoices0 + nv; i++) {
+      if (end - p < 1) break;
+      const int nzones = p[0];
+      if (nzones < 1 || nzones > k_fset_max_zones ||
+          end - p < 1 + 2 * nzones) break;
+      FormantSplit &s = sets[nsets];
+      int z;
+      for (z = 0; z < nzones && p[2 + 2*z] < nv; z++) {
+        s.top[z] = p[1 + 2*z];
+        s.voice[z] = p[2 + 2*z] + nvoices0;
+      }
+      if (z < nzones) break;
+      s.nzones = nzones;
+      p += 1 + 2 * nzones;
+      nsets++;
+    }
+
+    if (nvoices != nvoices0 + nv || nsets != nsets0 + ns) {
+      nvoices = nvoices0;
+      nsets = nsets0;
+      return -1;
+    }
+    return ns;
+  }
+
+  // voice for a given set and note
+  const FormantVoice &voice(int set, int note) const {
+    const FormantSplit &s = sets[set < nsets ? set : nsets - 1];
+    int z = 0;
+    while (z < s.nzones - 1 && note >= s.top[z]) z++;
+    return voices[s.voice[z]];
+  }
+
+  static uint16_t rd16(const uint8_t *p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+  }
+};
+
+#endif // __formantset_h
@@ -10,6 +10,18 @@ UCXXSRC = formant.cpp
 
 UINCDIR =
 
+# To embed a formant set, compile it with tools/fsetc.py -c and add:
+# UDEFS = -DFORMANT_USER_SET=\"sets/myset.h\"
+# Formants rendered (1 - 8, default 4) can be set with -DFORMANT_NMAX=n
+# Aspiration amount (0 - 100%, default 0) can be set with -DFORMANT_BREATH=n
+# Pitch-synchronous parameter latching is enabled with -DFORMANT_PSYNC=1
+# Math approximations (Fast, Faster, Table or Reference, default Faster)
+# can be set with -DMODFM_MATH=name
+# The 1024-point sine table, in unit SRAM, is used with -DMODFM_SINE=Full
+# The envelope decay time and sustain level (0 - 100%, defaults 0 and 100)
+# are set with -DMODFM_ENV_DECAY=n and -DMODFM_ENV_SUSTAIN=n
+# Hook calls are logged for the host replayer with -DOSC_TRACE (see
+# host/README.md), into OSC_TRACE_SIZE bytes (default 4096)
 UDEFS =
 
 ULIB = 
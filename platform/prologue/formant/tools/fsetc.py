@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+#  Formant set compiler
+#  Copyright 2020 Victor Lazzarini
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Compile a JSON formant set description into the binary format
+described in formantset.h.
+
+usage: fsetc.py input.json output.fset   (host, loaded with -f)
+       fsetc.py -c input.json output.h   (firmware, see project.mk)
+
+The description holds a list of voices, each a list of vowels, each a
+list of [freq, bw, amp] formants, and a list of sets, each a list of
+[top, voice] keyboard zones in ascending note order:
+
+{
+  "voices": [ { "name": "male", "vowels": [ [[730, 80, 1.0], ...], ... ] } ],
+  "sets": [ [[128, 0]] ]
+}
+"""
+
+import json
+import struct
+import sys
+
+VERSION = 1
+MAX_FORMANTS = 8
+MAX_VOWELS = 10
+MAX_VOICES = 8
+MAX_SETS = 16
+MAX_ZONES = 4
+
+
+def fail(msg):
+    sys.exit('fsetc: ' + msg)
+
+
+def compile_set(desc):
+    voices = desc.get('voices', [])
+    sets = desc.get('sets', [])
+    if not 1 <= len(voices) <= MAX_VOICES:
+        fail('need 1 - %d voices' % MAX_VOICES)
+    if not 1 <= len(sets) <= MAX_SETS:
+        fail('need 1 - %d sets' % MAX_SETS)
+    out = bytearray(b'FSET')
+    out += struct.pack('<BBBB', VERSION, len(voices), len(sets), 0)
+    for v in voices:
+        vowels = v['vowels']
+        if not 1 <= len(vowels) <= MAX_VOWELS:
+            fail('voice %s: need 1 - %d vowels' % (v.get('name'), MAX_VOWELS))
+        nform = len(vowels[0])
+        if not 1 <= nform <= MAX_FORMANTS:
+            fail('voice %s: need 1 - %d formants' % (v.get('name'), MAX_FORMANTS))
+        out += struct.pack('<BB', len(vowels), nform)
+        for vow in vowels:
+            if len(vow) != nform:
+                fail('voice %s: formant count mismatch' % v.get('name'))
+            for freq, bw, amp in vow:
+                if not 0 < freq <= 0xFFFF or not 0 < bw <= 0xFFFF:
+                    fail('voice %s: formant %g Hz, bandwidth %g Hz: need '
+                         '0 < freq, bw <= %d Hz'
+                         % (v.get('name'), freq, bw, 0xFFFF))
+                if amp < 0:
+                    fail('voice %s: formant %g Hz: negative amplitude %g'
+                         % (v.get('name'), freq, amp))
+                out += struct.pack('<HHH', int(round(freq)), int(round(bw)),
+                                   min(int(round(amp * 32768)), 0xFFFF))
+    for s in sets:
+        if not 1 <= len(s) <= MAX_ZONES:
+            fail('need 1 - %d zones per set' % MAX_ZONES)
+        out += struct.pack('<B', len(s))
+        for top, voice in s:
+            if not 0 <= voice < len(voices):
+                fail('zone voice %d out of range' % voice)
+            out += struct.pack('<BB', min(top, 128), voice)
+    return bytes(out)
+
+
+def as_header(data):
+    lines = ['// generated by fsetc.py, do not edit',
+             'static const uint8_t formant_user_set[] = {']
+    for i in range(0, len(data), 12):
+        lines.append('  ' + ', '.join('0x%02x' % b for b in data[i:i+12]) + ',')
+    lines.append('};')
+    return '\n'.join(lines) + '\n'
+
+
+def main(argv):
+    header = len(argv) > 1 and argv[1] == '-c'
+    args = argv[2:] if header else argv[1:]
+    if len(args) != 2:
+        sys.exit(__doc__)
+    with open(args[0]) as f:
+        data = compile_set(json.load(f))
+    if header:
+        with open(args[1], 'w') as f:
+            f.write(as_header(data))
+    else:
+        with open(args[1], 'wb') as f:
+            f.write(data)
+    print('%s: %d bytes' % (args[1], len(data)))
+
+
+if __name__ == '__main__':
+    main(sys.argv)
@@ -0,0 +1,113 @@
+/*  Host fill-ins for the CMSIS core intrinsics
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Stands in for CMSIS arm_math.h in host builds, so that
+// utils/cortexm4.h and utils/fixed_math.h compile natively.
+// Only the intrinsics used by the units and fixed_math.h are provided.
+
+#ifndef __host_arm_math_h
+#define __host_arm_math_h
+
+#include <stdint.h>
+
+#define __SIMD32_TYPE int32_t
+
+// GE flags as set by the SIMD add/subtract instructions, read by __SEL
+static uint32_t __host_ge;
+
+static inline int32_t __SSAT(int32_t x, uint32_t b) {
+  const int32_t mx = (int32_t) ((1U << (b - 1)) - 1);
+  const int32_t mn = -mx - 1;
+  return x > mx ? mx : (x < mn ? mn : x);
+}
+
+static inline uint32_t __USAT(int32_t x, uint32_t b) {
+  const int32_t mx = (int32_t) ((1U << b) - 1);
+  return x > mx ? (uint32_t) mx : (x < 0 ? 0U : (uint32_t) x);
+}
+
+static inline int32_t __QADD(int32_t a, int32_t b) {
+  const int64_t s = (int64_t) a + b;
+  return s > INT32_MAX ? INT32_MAX : (s < INT32_MIN ? INT32_MIN : (int32_t) s);
+}
+
+static inline int32_t __QSUB(int32_t a, int32_t b) {
+  const int64_t s = (int64_t) a - b;
+  return s > INT32_MAX ? INT32_MAX : (s < INT32_MIN ? INT32_MIN : (int32_t) s);
+}
+
+static inline int16_t __host_lo(int32_t x) { return (int16_t) (x & 0xFFFF); }
+static inline int16_t __host_hi(int32_t x) { return (int16_t) (x >> 16); }
+static inline int32_t __host_pack(int32_t lo, int32_t hi) {
+  return (int32_t) (((uint32_t) hi << 16) | ((uint32_t) lo & 0xFFFF));
+}
+
+static inline int32_t __QADD16(int32_t a, int32_t b) {
+  return __host_pack(__SSAT(__host_lo(a) + __host_lo(b), 16),
+                     __SSAT(__host_hi(a) + __host_hi(b), 16));
+}
+
+static inline int32_t __QSUB16(int32_t a, int32_t b) {
+  return __host_pack(__SSAT(__host_lo(a) - __host_lo(b), 16),
+                     __SSAT(__host_hi(a) - __host_hi(b), 16));
+}
+
+static inline int32_t __SADD16(int32_t a, int32_t b) {
+  const int32_t lo = __host_lo(a) + __host_lo(b);
+  const int32_t hi = __host_hi(a) + __host_hi(b);
+  __host_ge = (lo >= 0 ? 0x3U : 0U) | (hi >= 0 ? 0xCU : 0U);
+  return __host_pack(lo, hi);
+}
+
+static inline int32_t __SSUB16(int32_t a, int32_t b) {
+  const int32_t lo = __host_lo(a) - __host_lo(b);
+  const int32_t hi = __host_hi(a) - __host_hi(b);
+  __host_ge = (lo >= 0 ? 0x3U : 0U) | (hi >= 0 ? 0xCU : 0U);
+  return __host_pack(lo, hi);
+}
+
+static inline int32_t __SEL(int32_t a, int32_t b) {
+  uint32_t r = 0;
+  for (int i = 0; i < 4; i++) {
+    const uint32_t m = 0xFFU << (i * 8);
+    r |= ((__host_ge >> i) & 1U ? (uint32_t) a : (uint32_t) b) & m;
+  }
+  return (int32_t) r;
+}
+
+static inline int32_t __SMUAD(int32_t a, int32_t b) {
+  return __host_lo(a) * __host_lo(b) + __host_hi(a) * __host_hi(b);
+}
+
+static inline int32_t __SMLAD(int32_t a, int32_t b, int32_t acc) {
+  return acc + __SMUAD(a, b);
+}
+
+static inline int64_t __SMLALD(int32_t a, int32_t b, int64_t acc) {
+  return acc + (int64_t) __host_lo(a) * __host_lo(b) +
+    (int64_t) __host_hi(a) * __host_hi(b);
+}
+
+static inline int32_t __PKHBT(int32_t a, int32_t b, uint32_t sh) {
+  return (int32_t) (((uint32_t) a & 0xFFFF) | (((uint32_t) b << sh) & 0xFFFF0000U));
+}
+
+static inline uint32_t __CLZ(uint32_t x) {
+  return x ? (uint32_t) __builtin_clz(x) : 32U;
+}
+
+#endif // __host_arm_math_h
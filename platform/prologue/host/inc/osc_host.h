@@ -0,0 +1,74 @@
+/*  Host runtime for user oscillators
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef __osc_host_h
+#define __osc_host_h
+
+#include "userosc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /**
+   * Set the sample rate and fill in the firmware lookup tables. Called
+   * once by the host driver before the unit's init hook.
+   *
+   * @param srate Sample rate (Hz), 48000 on the prologue.
+   */
+  void osc_host_init(uint32_t srate);
+
+  /**
+   * Write a mono 32-bit float WAV file at the current rate.
+   *
+   * @param path File name.
+   * @param sig  Samples.
+   * @param n    Sample count.
+   * @return 0 on success, non-zero on failure.
+   */
+  int osc_host_write_wav(const char *path, const float *sig, uint32_t n);
+
+  /**
+   * Read a whole file.
+   *
+   * @param path File name.
+   * @param n    Output, its size in bytes.
+   * @return Its contents, to be freed by the caller, or NULL.
+   */
+  uint8_t *osc_host_read_file(const char *path, uint32_t *n);
+
+  /**
+   * Optional unit hook: load a unit-specific data file.
+   *
+   * @param path File name.
+   * @return 0 on success, non-zero on failure.
+   */
+  int osc_host_load(const char *path);
+
+  /**
+   * Note-on position within the next block, in 1/256 frames (8.8
+   * fixed point), read from the note-on parameters. The host driver
+   * sets it in a reserved field; the firmware always starts notes at
+   * the block boundary, so units read it on host builds only.
+   */
+#define osc_noteon_offset(p) ((uint32_t) (p)->reserved0[0])
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __osc_host_h
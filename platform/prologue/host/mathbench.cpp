@@ -0,0 +1,233 @@
+/*  Math approximation policy benchmark
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Times each function of each dsp::MathPolicy over the argument
+// ranges the units use, and measures its error against double
+// precision libm: relative for exp, pow2 and pow, absolute for
+// log2 and cos. Then times the sine lookups in an oscillator loop,
+// with float and 32-bit phases, and measures their THD.
+
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+#include "osc_host.h"
+#include "mathpolicy.hpp"
+
+#define NARGS 4096
+#define NREPS 1000
+#define NRUNS 5
+
+static float xs[NARGS], ys[NARGS];
+static volatile float sink;
+
+struct Fn {
+  const char *name;
+  float lo, hi;      // argument range
+  bool rel;          // relative error
+};
+
+static const Fn fns[] = {
+  {"exp", -15.f, 0.f, true},
+  {"pow2", -20.f, 4.f, true},
+  {"pow", 1.f, 11.f, true},   // 1 - 11 to the 0 - 1
+  {"log2", 0.001f, 100.f, false},
+  {"cos", 0.f, 1.f, false}
+};
+
+static double ref(int f, float x, float y) {
+  switch (f) {
+  case 0: return exp((double) x);
+  case 1: return exp2((double) x);
+  case 2: return pow((double) x, (double) y);
+  case 3: return log2((double) x);
+  default: return cos(2. * M_PI * x);
+  }
+}
+
+template<class M>
+static inline float eval(int f, float x, float y) {
+  switch (f) {
+  case 0: return M::exp(x);
+  case 1: return M::pow2(x);
+  case 2: return M::pow(x, y);
+  case 3: return M::log2(x);
+  default: return M::cos(x);
+  }
+}
+
+// one function over the argument table, the switch hoisted
+template<class M, int F>
+static float run(void) {
+  float acc = 0.f;
+  for (int r = 0; r < NREPS; r++)
+    for (int i = 0; i < NARGS; i++)
+      acc += eval<M>(F, xs[i], ys[i]);
+  return acc;
+}
+
+template<class M>
+static void bench(const char *name) {
+  typedef float (*run_fn)(void);
+  static const run_fn runs[] = {
+    run<M, 0>, run<M, 1>, run<M, 2>, run<M, 3>, run<M, 4>
+  };
+  printf("%-10s", name);
+  for (int f = 0; f < 5; f++) {
+    const Fn &fn = fns[f];
+    for (int i = 0; i < NARGS; i++) {
+      xs[i] = fn.lo + (fn.hi - fn.lo) * i / NARGS;
+      ys[i] = (float) ((i * 37) % NARGS) / NARGS;
+    }
+    double err = 0.;
+    for (int i = 0; i < NARGS; i++) {
+      const double r = ref(f, xs[i], ys[i]);
+      double e = fabs(eval<M>(f, xs[i], ys[i]) - r);
+      if (fn.rel) e /= fabs(r);
+      err = e > err ? e : err;
+    }
+    // best of NRUNS
+    double ns = 1e9;
+    for (int k = 0; k < NRUNS; k++) {
+      const clock_t t0 = clock();
+      sink = runs[f]();
+      const double t = 1e9 * (clock() - t0) / CLOCKS_PER_SEC /
+        ((double) NARGS * NREPS);
+      ns = t < ns ? t : ns;
+    }
+    printf("  %5.2f ns %8.1e", ns, err);
+  }
+  printf("\n");
+}
+
+// sine lookups, float or 32-bit phase
+struct FirmwareF {
+  static float sin(float x) { return osc_sinf(x); }
+};
+struct FirmwareU {
+  static float sin(uint32_t x) { return osc_sinuf(x); }
+};
+struct FullF {
+  static float sin(float x) { return dsp::SineLookup<dsp::Full>::sin(x); }
+};
+struct FullU {
+  static float sin(uint32_t x) { return dsp::SineLookup<dsp::Full>::sinu(x); }
+};
+struct LibmF {
+  static float sin(float x) { return sinf(M_TWOPI * x); }
+};
+
+#define NSINE (1 << 16)
+#define SINE_W 0.0123457f
+
+template<class L>
+static float oscf(void) {
+  float acc = 0.f, ph = 0.f;
+  for (int r = 0; r < NREPS; r++)
+    for (int i = 0; i < NARGS; i++) {
+      acc += L::sin(ph);
+      ph += SINE_W;
+      ph -= (uint32_t) ph;
+    }
+  return acc;
+}
+
+template<class L>
+static float oscu(void) {
+  const uint32_t w = osc_phaseu(SINE_W);
+  uint32_t ph = 0;
+  float acc = 0.f;
+  for (int r = 0; r < NREPS; r++)
+    for (int i = 0; i < NARGS; i++) {
+      acc += L::sin(ph);
+      ph += w;
+    }
+  return acc;
+}
+
+template<class L>
+static float evalf(double t) { return L::sin((float) t); }
+
+template<class L>
+static float evalu(double t) {
+  return L::sin((uint32_t) (t * 4294967296.));
+}
+
+// THD of one period sampled at NSINE points, in dB: everything
+// but the fundamental, over the fundamental
+static double thd(float (*eval)(double)) {
+  static float y[NSINE];
+  double a = 0., b = 0., r = 0.;
+  for (int i = 0; i < NSINE; i++) {
+    const double t = (i + 0.37) / NSINE;
+    y[i] = eval(t);
+    a += y[i] * sin(2. * M_PI * t);
+    b += y[i] * cos(2. * M_PI * t);
+  }
+  a *= 2. / NSINE;
+  b *= 2. / NSINE;
+  for (int i = 0; i < NSINE; i++) {
+    const double t = (i + 0.37) / NSINE;
+    const double e = y[i] - a * sin(2. * M_PI * t) - b * cos(2. * M_PI * t);
+    r += e * e;
+  }
+  return 10. * log10(r / (NSINE * (a * a + b * b) / 2.));
+}
+
+struct Sine {
+  const char *name;
+  float (*run)(void);
+  float (*eval)(double);
+};
+
+static const Sine sines[] = {
+  {"osc_sinf", oscf<FirmwareF>, evalf<FirmwareF>},
+  {"osc_sinuf", oscu<FirmwareU>, evalu<FirmwareU>},
+  {"Full::sin", oscf<FullF>, evalf<FullF>},
+  {"Full::sinu", oscu<FullU>, evalu<FullU>},
+  {"sinf", oscf<LibmF>, evalf<LibmF>}
+};
+
+static void bench_sines(void) {
+  printf("\n%-14s  %-8s  %s\n", "sine", "time", "THD");
+  for (size_t k = 0; k < sizeof(sines) / sizeof(sines[0]); k++) {
+    double ns = 1e9;
+    for (int j = 0; j < NRUNS; j++) {
+      const clock_t t0 = clock();
+      sink = sines[k].run();
+      const double t = 1e9 * (clock() - t0) / CLOCKS_PER_SEC /
+        ((double) NARGS * NREPS);
+      ns = t < ns ? t : ns;
+    }
+    printf("%-14s  %5.2f ns  %6.1f dB\n", sines[k].name, ns,
+           thd(sines[k].eval));
+  }
+}
+
+int main(void) {
+  osc_host_init(48000);
+  dsp::SineLookup<dsp::Full>::init();
+  printf("%-10s", "policy");
+  for (int f = 0; f < 5; f++)
+    printf("  %-17s", fns[f].name);
+  printf("\n");
+  bench<dsp::MathPolicy<dsp::Fast> >("Fast");
+  bench<dsp::MathPolicy<dsp::Faster> >("Faster");
+  bench<dsp::MathPolicy<dsp::Table> >("Table");
+  bench<dsp::MathPolicy<dsp::Reference> >("Reference");
+  bench_sines();
+  return 0;
+}
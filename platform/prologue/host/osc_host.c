@@ -0,0 +1,165 @@
+/*  Host runtime for user oscillators
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Native stand-ins for the symbols in ld/osc_api.syms. Only the tables
+// and functions used by the units in this repository are provided.
+// Also the default hooks and the file helpers shared by the drivers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "osc_host.h"
+
+const uint32_t k_osc_api_version = USER_API_VERSION;
+const uint32_t k_osc_api_platform = USER_TARGET_PLATFORM;
+
+// Tables are declared const by osc_api.h; they are filled in at init
+// through writable storage aliased to the API symbol names.
+#define HOST_LUT(name, size)                                            \
+  static float s_##name[size];                                          \
+  extern const float name[size] __attribute__((alias("s_" #name)))
+
+HOST_LUT(midi_to_hz_lut_f, k_midi_to_hz_size);
+HOST_LUT(wt_sine_lut_f, k_wt_sine_lut_size);
+HOST_LUT(log_lut_f, k_log_lut_size);
+HOST_LUT(tanpi_lut_f, k_log_lut_size);
+HOST_LUT(sqrtm2log_lut_f, k_sqrtm2log_lut_size);
+
+uint32_t osc_host_samplerate = 48000;
+float osc_host_samplerate_recipf = 1.f / 48000;
+
+static uint32_t s_rand_state = 1;
+
+void osc_host_init(uint32_t srate) {
+  osc_host_samplerate = srate;
+  osc_host_samplerate_recipf = 1.f / srate;
+  for (uint32_t i = 0; i < k_midi_to_hz_size; i++)
+    s_midi_to_hz_lut_f[i] = 440.0 * pow(2.0, (i - 69.0) / 12.0);
+  for (uint32_t i = 0; i < k_wt_sine_lut_size; i++)
+    s_wt_sine_lut_f[i] = sin(M_PI * i / k_wt_sine_size);
+  for (uint32_t i = 0; i < k_log_lut_size; i++)
+    s_log_lut_f[i] = log(i ? (double) i / k_log_size : 0.00001);
+  for (uint32_t i = 0; i < k_tanpi_lut_size; i++)
+    s_tanpi_lut_f[i] = tan(M_PI * (0.0001 + 0.49 * i / k_tanpi_size));
+  for (uint32_t i = 0; i < k_sqrtm2log_lut_size; i++)
+    s_sqrtm2log_lut_f[i] =
+      sqrt(-2.0 * log(k_sqrtm2log_base + (1.0 - k_sqrtm2log_base) * i / k_sqrtm2log_size));
+  s_rand_state = 1;
+}
+
+uint32_t _osc_mcu_hash(void) {
+  return 0x484F5354; // 'HOST'
+}
+
+uint32_t _osc_rand(void) {
+  // Park-Miller-Carta, as in the firmware
+  uint32_t lo = 16807 * (s_rand_state & 0xFFFF);
+  const uint32_t hi = 16807 * (s_rand_state >> 16);
+  lo += (hi & 0x7FFF) << 16;
+  lo += hi >> 15;
+  lo = (lo & 0x7FFFFFFF) + (lo >> 31);
+  return (s_rand_state = lo);
+}
+
+float _osc_white(void) {
+  // Gaussian via the sum of uniform variates, clipped to [-1, 1]
+  float s = 0.f;
+  for (int i = 0; i < 4; i++)
+    s += _osc_rand() * (1.f / 0x7FFFFFFF) - 0.5f;
+  return clip1m1f(s * 0.5f);
+}
+
+// Default hooks, as in tpl/_unit.c, for the ones a unit leaves out
+
+__attribute__((weak)) void _hook_init(uint32_t platform, uint32_t api) {
+  (void) platform;
+  (void) api;
+}
+
+__attribute__((weak))
+void _hook_cycle(const user_osc_param_t * const params, int32_t *yn,
+                 const uint32_t frames) {
+  (void) params;
+  (void) yn;
+  (void) frames;
+}
+
+__attribute__((weak)) void _hook_on(const user_osc_param_t * const params) {
+  (void) params;
+}
+
+__attribute__((weak)) void _hook_off(const user_osc_param_t * const params) {
+  (void) params;
+}
+
+__attribute__((weak)) void _hook_mute(const user_osc_param_t * const params) {
+  (void) params;
+}
+
+__attribute__((weak)) void _hook_value(uint16_t value) {
+  (void) value;
+}
+
+__attribute__((weak)) void _hook_param(uint16_t index, uint16_t value) {
+  (void) index;
+  (void) value;
+}
+
+static void write_u32(FILE *fp, uint32_t v) {
+  const uint8_t b[4] = {v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24};
+  fwrite(b, 1, 4, fp);
+}
+
+static void write_u16(FILE *fp, uint16_t v) {
+  const uint8_t b[2] = {v & 0xFF, v >> 8};
+  fwrite(b, 1, 2, fp);
+}
+
+int osc_host_write_wav(const char *path, const float *sig, uint32_t n) {
+  FILE *fp = fopen(path, "wb");
+  if (fp == NULL) return -1;
+  fwrite("RIFF", 1, 4, fp);
+  write_u32(fp, 36 + n * 4);
+  fwrite("WAVEfmt ", 1, 8, fp);
+  write_u32(fp, 16);
+  write_u16(fp, 3); // IEEE float
+  write_u16(fp, 1);
+  write_u32(fp, k_samplerate);
+  write_u32(fp, k_samplerate * 4);
+  write_u16(fp, 4);
+  write_u16(fp, 32);
+  fwrite("data", 1, 4, fp);
+  write_u32(fp, n * 4);
+  fwrite(sig, sizeof(float), n, fp);
+  fclose(fp);
+  return 0;
+}
+
+uint8_t *osc_host_read_file(const char *path, uint32_t *n) {
+  FILE *fp = fopen(path, "rb");
+  uint8_t *b = NULL;
+  long len;
+  if (fp == NULL) return NULL;
+  if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0 &&
+      fseek(fp, 0, SEEK_SET) == 0 && (b = malloc(len)) != NULL &&
+      fread(b, 1, len, fp) != (size_t) len) {
+    free(b);
+    b = NULL;
+  }
+  *n = b != NULL ? (uint32_t) len : 0;
+  fclose(fp);
+  return b;
+}
@@ -0,0 +1,173 @@
+/*  Host stage timers for user oscillators
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Counters and report for inc/osc_prof.h. User-space cycles and
+// instructions come from a perf_event_open group, read with one
+// read(); the kernel side of the read is excluded from the counts.
+// Without a PMU, or with OSC_PROF_COUNTERS=tsc in the environment,
+// the time stamp counter (or a monotonic clock, off x86) is used.
+// The cost of an empty stage is measured at init and taken off
+// each timed call.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "osc_host.h"
+#include "osc_prof.h"
+
+static osc_prof_stage_t *s_stages = NULL, **s_last = &s_stages;
+static int s_fd = -1;
+static uint64_t s_cost[2] = {0, 0};
+
+#ifdef __linux__
+static int perf_open(uint64_t config, int group) {
+  struct perf_event_attr a;
+  memset(&a, 0, sizeof(a));
+  a.size = sizeof(a);
+  a.type = PERF_TYPE_HARDWARE;
+  a.config = config;
+  a.exclude_kernel = 1;
+  a.exclude_hv = 1;
+  a.read_format = PERF_FORMAT_GROUP;
+  return (int) syscall(SYS_perf_event_open, &a, 0, -1, group, 0);
+}
+#endif
+
+void osc_prof_init(void) {
+#ifdef __linux__
+  const char *c = getenv("OSC_PROF_COUNTERS");
+  if (c == NULL || strcmp(c, "tsc") != 0) {
+    s_fd = perf_open(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (s_fd >= 0 && perf_open(PERF_COUNT_HW_INSTRUCTIONS, s_fd) < 0) {
+      close(s_fd);
+      s_fd = -1;
+    }
+  }
+#endif
+  // cost of an empty stage, the least of many
+  s_cost[0] = s_cost[1] = ~0ULL;
+  for (int i = 0; i < 1000; i++) {
+    uint64_t v0[2], v1[2];
+    osc_prof_read(v0);
+    osc_prof_read(v1);
+    for (int j = 0; j < 2; j++)
+      if (v1[j] - v0[j] < s_cost[j]) s_cost[j] = v1[j] - v0[j];
+  }
+}
+
+void osc_prof_read(uint64_t v[2]) {
+#ifdef __linux__
+  if (s_fd >= 0) {
+    uint64_t b[3]; // count, cycles, instructions
+    if (read(s_fd, b, sizeof(b)) == sizeof(b)) {
+      v[0] = b[1];
+      v[1] = b[2];
+      return;
+    }
+  }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_lfence();
+  v[0] = __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  v[0] = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+  v[1] = 0;
+}
+
+static void list(osc_prof_stage_t *s) {
+  if (s->listed) return;
+  s->listed = 1;
+  *s_last = s;
+  s_last = &s->next;
+}
+
+void osc_prof_add(osc_prof_stage_t *s, const uint64_t v0[2], uint32_t frames) {
+  uint64_t v[2];
+  osc_prof_read(v);
+  for (int j = 0; j < 2; j++) {
+    const uint64_t d = v[j] - v0[j];
+    s->count[j] += d > s_cost[j] ? d - s_cost[j] : 0;
+  }
+  s->calls++;
+  s->frames += frames;
+  s->timed = 1;
+  list(s);
+}
+
+void osc_prof_count(osc_prof_stage_t *s, uint32_t n) {
+  s->calls++;
+  s->frames += n;
+  list(s);
+}
+
+void osc_prof_report(void) {
+  const char *unit = s_fd >= 0 ? "cycles" : "ticks";
+  // the driver's OSC_CYCLE stage is the total
+  uint64_t total = 0, tframes = 0;
+  for (osc_prof_stage_t *s = s_stages; s != NULL; s = s->next)
+    if (strcmp(s->name, "OSC_CYCLE") == 0) {
+      total += s->count[0];
+      tframes += s->frames;
+    }
+
+  fprintf(stderr, "\n%-16s %9s %10s %12s %12s %7s%s\n", "stage", "calls",
+          "frames", unit, "per frame", "%", s_fd >= 0 ? "     IPC" : "");
+  for (osc_prof_stage_t *s = s_stages; s != NULL; s = s->next) {
+    if (!s->listed) continue;
+    // merge the call sites sharing the name
+    osc_prof_stage_t m = *s;
+    for (osc_prof_stage_t *t = s->next; t != NULL; t = t->next)
+      if (t->listed && strcmp(t->name, s->name) == 0) {
+        m.calls += t->calls;
+        m.frames += t->frames;
+        m.count[0] += t->count[0];
+        m.count[1] += t->count[1];
+        t->listed = 0;
+      }
+    if (!m.timed) {
+      fprintf(stderr, "%-16s %9llu %10llu\n", m.name,
+              (unsigned long long) m.calls, (unsigned long long) m.frames);
+      continue;
+    }
+    // per frame of the whole run, so the stages add up
+    fprintf(stderr, "%-16s %9llu %10llu %12llu %12.1f %7.1f", m.name,
+            (unsigned long long) m.calls, (unsigned long long) m.frames,
+            (unsigned long long) m.count[0],
+            tframes ? (double) m.count[0] / tframes : 0.,
+            total ? 100. * m.count[0] / total : 0.);
+    if (s_fd >= 0)
+      fprintf(stderr, " %7.2f",
+              m.count[0] ? (double) m.count[1] / m.count[0] : 0.);
+    fprintf(stderr, "\n");
+  }
+  if (tframes)
+    fprintf(stderr, "%.0f %s per 64-frame block; %llu %s per stage "
+            "taken off as timer cost\n", 64. * total / tframes, unit,
+            (unsigned long long) s_cost[0], unit);
+}
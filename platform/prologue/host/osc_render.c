@@ -0,0 +1,192 @@
+/*  Host render driver for user oscillators
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "osc_host.h"
+#include "osc_trace.h"
+#include "osc_prof.h"
+
+#define MAX_FRAMES 64
+#define MAX_PARAMS 32
+
+__attribute__((weak)) int osc_host_load(const char *path);
+
+static FILE *s_trace = NULL;
+static osc_trace_state_t s_trace_state;
+
+// log a hook call, with -T
+static void trace(uint8_t type, const user_osc_param_t *p, uint32_t frames,
+                  uint32_t x, uint32_t y) {
+  uint8_t b[k_osc_trace_max_record];
+  if (s_trace == NULL) return;
+  fwrite(b, 1, osc_trace_encode(&s_trace_state, b, type, p, frames, x, y),
+         s_trace);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -o file     output WAV file (32-bit float, mono)\n"
+          "  -n note     MIDI note number (default 60)\n"
+          "  -d secs     note duration (default 1)\n"
+          "  -r secs     release tail after note off (default 0.5)\n"
+          "  -p id=val   OSC_PARAM index and value, may be repeated\n"
+          "  -l val      shape LFO value in [-1, 1] (default 0)\n"
+          "  -t secs     retrigger the note every secs while it is held\n"
+          "  -s rate     sample rate in Hz (default 48000)\n"
+          "  -f file     unit data file\n"
+          "  -T file     record the hook calls to a trace file\n", name);
+}
+
+// render n frames; with retrig > 0, the note is retriggered every
+// retrig frames, its exact position within the block passed as
+// the note-on offset
+static uint32_t render(user_osc_param_t *p, float *out, uint32_t n,
+                       double retrig) {
+  int32_t yn[MAX_FRAMES];
+  uint32_t done = 0;
+  double next = retrig;
+  while (done < n) {
+    const uint32_t frames = n - done < MAX_FRAMES ? n - done : MAX_FRAMES;
+    if (retrig > 0. && next < done + frames) {
+      p->reserved0[0] = (uint16_t) ((next - done) * 256.);
+      trace(k_osc_trace_on, p, 0, 0, 0);
+      _hook_on(p);
+      p->reserved0[0] = 0;
+      next += retrig;
+    }
+    trace(k_osc_trace_cycle, p, frames, 0, 0);
+    OSC_PROF_BEGIN(cycle, "OSC_CYCLE");
+    _hook_cycle(p, yn, frames);
+    OSC_PROF_END(cycle, frames);
+    for (uint32_t i = 0; i < frames; i++)
+      out[done + i] = q31_to_f32(yn[i]);
+    done += frames;
+  }
+  return done;
+}
+
+int main(int argc, char **argv) {
+  const char *out = NULL, *data = NULL, *tfile = NULL;
+  int note = 60;
+  float dur = 1.f, rel = .5f, lfo = 0.f, retrig = 0.f;
+  uint32_t srate = 48000;
+  uint16_t pid[MAX_PARAMS], pval[MAX_PARAMS];
+  int np = 0, opt;
+
+  while ((opt = getopt(argc, argv, "o:n:d:r:p:l:t:s:f:T:h")) != -1) {
+    switch (opt) {
+    case 'o': out = optarg; break;
+    case 'n': note = atoi(optarg); break;
+    case 'd': dur = atof(optarg); break;
+    case 'r': rel = atof(optarg); break;
+    case 'l': lfo = clip1m1f(atof(optarg)); break;
+    case 't': retrig = atof(optarg); break;
+    case 's': srate = (uint32_t) atoi(optarg); break;
+    case 'f': data = optarg; break;
+    case 'T': tfile = optarg; break;
+    case 'p': {
+      unsigned int id, val;
+      if (np == MAX_PARAMS || sscanf(optarg, "%u=%u", &id, &val) != 2) {
+        usage(argv[0]);
+        return 1;
+      }
+      pid[np] = id;
+      pval[np++] = val;
+      break;
+    }
+    default:
+      usage(argv[0]);
+      return opt != 'h';
+    }
+  }
+
+  if (srate < 8000) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  osc_host_init(srate);
+#ifdef OSC_PROF
+  osc_prof_init();
+#endif
+  if (tfile != NULL) {
+    uint8_t h[k_osc_trace_header_size];
+    if ((s_trace = fopen(tfile, "wb")) == NULL) {
+      fprintf(stderr, "%s: could not open %s\n", argv[0], tfile);
+      return 1;
+    }
+    fwrite(h, 1, osc_trace_header(h, k_samplerate), s_trace);
+    osc_trace_reset(&s_trace_state);
+  }
+  trace(k_osc_trace_init, NULL, 0, k_osc_api_platform, k_osc_api_version);
+  _hook_init(k_osc_api_platform, k_osc_api_version);
+  if (data != NULL) {
+    if (osc_host_load == NULL || osc_host_load(data) != 0) {
+      fprintf(stderr, "%s: could not load %s\n", argv[0], data);
+      return 1;
+    }
+    // the replay checks it is given the same file
+    uint32_t n;
+    uint8_t *b = osc_host_read_file(data, &n);
+    trace(k_osc_trace_data, NULL, 0, n, osc_trace_hash(2166136261U, b, n));
+    free(b);
+  }
+  for (int i = 0; i < np; i++) {
+    trace(k_osc_trace_param, NULL, 0, pid[i], pval[i]);
+    _hook_param(pid[i], pval[i]);
+  }
+
+  user_osc_param_t params;
+  memset(&params, 0, sizeof(params));
+  params.pitch = (uint16_t) (note << 8);
+  params.shape_lfo = f32_to_q31(lfo);
+
+  const uint32_t on = (uint32_t) (dur * k_samplerate);
+  const uint32_t off = (uint32_t) (rel * k_samplerate);
+  float *sig = malloc(sizeof(float) * (on + off));
+  if (sig == NULL) return 1;
+
+  const clock_t t0 = clock();
+  // at most one retrigger per block
+  const double period = retrig * k_samplerate;
+  trace(k_osc_trace_on, &params, 0, 0, 0);
+  _hook_on(&params);
+  render(&params, sig, on, period < MAX_FRAMES ? 0. : period);
+  trace(k_osc_trace_off, &params, 0, 0, 0);
+  _hook_off(&params);
+  render(&params, sig + on, off, 0.);
+  const double secs = (double) (clock() - t0) / CLOCKS_PER_SEC;
+
+  fprintf(stderr, "%u frames in %.3f ms (%.1fx realtime)\n", on + off,
+          secs * 1000., secs > 0. ? (on + off) / (secs * k_samplerate) : 0.);
+#ifdef OSC_PROF
+  osc_prof_report();
+#endif
+  if (out != NULL && osc_host_write_wav(out, sig, on + off) != 0) {
+    fprintf(stderr, "%s: could not write %s\n", argv[0], out);
+    free(sig);
+    return 1;
+  }
+  free(sig);
+  if (s_trace != NULL) fclose(s_trace);
+  return 0;
+}
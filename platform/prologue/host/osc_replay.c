@@ -0,0 +1,206 @@
+/*  Host trace replayer for user oscillators
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Feeds a hook call trace (osc_trace.h) to a unit and times each
+// call, reporting the time per hook type, the cycle time per frame
+// at the median, 99th percentile and worst block, and a hash of the
+// output, so that two builds can be checked for the same result.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "osc_host.h"
+#include "osc_trace.h"
+#include "osc_prof.h"
+
+#define MAX_FRAMES 1024
+
+__attribute__((weak)) int osc_host_load(const char *path);
+
+static const char *s_names[] = {
+  "init", "cycle", "on", "off", "mute", "value", "param", "data"
+};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options] trace\n"
+          "  -o file     output WAV file (32-bit float, mono)\n"
+          "  -f file     unit data file, for traces recorded with one\n",
+          name);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b) {
+  const float x = *(const float *) a, y = *(const float *) b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+  const char *out = NULL, *data = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "o:f:h")) != -1) {
+    switch (opt) {
+    case 'o': out = optarg; break;
+    case 'f': data = optarg; break;
+    default:
+      usage(argv[0]);
+      return opt != 'h';
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  uint32_t n;
+  uint8_t *b = osc_host_read_file(argv[optind], &n);
+  if (b == NULL || n < k_osc_trace_header_size || memcmp(b, "OSCT", 4)) {
+    fprintf(stderr, "%s: could not read a trace from %s\n", argv[0],
+            argv[optind]);
+    free(b);
+    return 1;
+  }
+  osc_host_init(osc_trace_get32(b + 4));
+#ifdef OSC_PROF
+  osc_prof_init();
+#endif
+
+  // first pass: count the calls and frames
+  osc_trace_state_t s;
+  osc_trace_record_t r;
+  uint32_t count[k_osc_trace_type_mask + 1] = {0};
+  uint32_t frames = 0, k, m;
+  osc_trace_reset(&s);
+  for (k = k_osc_trace_header_size; (m = osc_trace_decode(&s, b + k, n - k, &r));
+       k += m) {
+    if (r.type == k_osc_trace_cycle) {
+      if (r.frames > MAX_FRAMES) break;
+      frames += r.frames;
+    }
+    count[r.type]++;
+  }
+  if (k != n)
+    fprintf(stderr, "%s: stopped at a bad record, byte %u of %u\n",
+            argv[0], k, n);
+  const uint32_t end = k;
+  // a trace recorded with -f replays only with the same file
+  uint32_t dn = 0, dhash = 0;
+  uint8_t *d = data != NULL ? osc_host_read_file(data, &dn) : NULL;
+  if (data != NULL && d == NULL) {
+    fprintf(stderr, "%s: could not read %s\n", argv[0], data);
+    free(b);
+    return 1;
+  }
+  if (d != NULL) dhash = osc_trace_hash(2166136261U, d, dn);
+  free(d);
+  if ((count[k_osc_trace_data] != 0) != (data != NULL)) {
+    fprintf(stderr, data != NULL ?
+            "%s: the trace was recorded without a data file\n" :
+            "%s: the trace was recorded with a data file, give it with -f\n",
+            argv[0]);
+    free(b);
+    return 1;
+  }
+
+  float *sig = malloc(sizeof(float) * (frames + 1));
+  float *per = malloc(sizeof(float) * (count[k_osc_trace_cycle] + 1));
+  if (sig == NULL || per == NULL) return 1;
+
+  // second pass: make the calls
+  double t[k_osc_trace_type_mask + 1] = {0.};
+  int32_t yn[MAX_FRAMES];
+  uint32_t done = 0, ncyc = 0, hash = 2166136261U;
+  osc_trace_reset(&s);
+  for (k = k_osc_trace_header_size; k < end; k += m) {
+    m = osc_trace_decode(&s, b + k, end - k, &r);
+    const double t0 = now();
+    switch (r.type) {
+    case k_osc_trace_init: _hook_init(r.a, r.b); break;
+    case k_osc_trace_cycle: {
+      OSC_PROF_BEGIN(cycle, "OSC_CYCLE");
+      _hook_cycle(&r.params, yn, r.frames);
+      OSC_PROF_END(cycle, r.frames);
+      break;
+    }
+    case k_osc_trace_on: _hook_on(&r.params); break;
+    case k_osc_trace_off: _hook_off(&r.params); break;
+    case k_osc_trace_mute: _hook_mute(&r.params); break;
+    case k_osc_trace_value: _hook_value(r.a); break;
+    case k_osc_trace_data:
+      if (r.a != dn || r.b != dhash) {
+        fprintf(stderr, "%s: %s is not the data file of the trace\n",
+                argv[0], data);
+        return 1;
+      }
+      if (osc_host_load == NULL || osc_host_load(data) != 0) {
+        fprintf(stderr, "%s: could not load %s\n", argv[0], data);
+        return 1;
+      }
+      break;
+    default: _hook_param(r.a, r.b); break;
+    }
+    const double dt = now() - t0;
+    t[r.type] += dt;
+    if (r.type == k_osc_trace_cycle) {
+      per[ncyc++] = r.frames ? dt / r.frames : 0.f;
+      for (uint32_t i = 0; i < r.frames; i++) {
+        // FNV-1a over the output words
+        for (int j = 0; j < 32; j += 8)
+          hash = (hash ^ ((uint32_t) yn[i] >> j & 0xFF)) * 16777619U;
+        sig[done + i] = q31_to_f32(yn[i]);
+      }
+      done += r.frames;
+    }
+  }
+
+  double total = 0.;
+  for (int i = 0; i <= k_osc_trace_data; i++) {
+    total += t[i];
+    if (count[i])
+      printf("%-6s %8u calls %10.3f ms\n", s_names[i], count[i], t[i] * 1e-6);
+  }
+  if (ncyc) {
+    qsort(per, ncyc, sizeof(float), cmp);
+    printf("cycle ns/frame: median %.1f, p99 %.1f, max %.1f\n",
+           per[ncyc / 2], per[ncyc * 99 / 100], per[ncyc - 1]);
+  }
+  printf("%u frames in %.3f ms (%.1fx realtime), output hash %08x\n",
+         done, total * 1e-6,
+         total > 0. ? done / (total * 1e-9 * k_samplerate) : 0., hash);
+
+#ifdef OSC_PROF
+  osc_prof_report();
+#endif
+
+  int ret = 0;
+  if (out != NULL && osc_host_write_wav(out, sig, done) != 0) {
+    fprintf(stderr, "%s: could not write %s\n", argv[0], out);
+    ret = 1;
+  }
+  free(per);
+  free(sig);
+  free(b);
+  return ret;
+}
@@ -0,0 +1,179 @@
+#pragma once
+/*  Fixed-point ModFM kernel
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    fixedmodfm.hpp
+ * @brief   Integer ModFM kernel: 32-bit phases, q15 sine and
+ *          exponential tables interpolated with the M4 dual
+ *          16-bit multiplies.
+ *
+ * @addtogroup dsp DSP
+ * @{
+ */
+
+#include <stdint.h>
+#include "userosc.h"
+
+// sine, one period over 2^32, and 2^-x, x in 0 - 1
+#define k_fxmodfm_sine_size_exp (10)
+#define k_fxmodfm_sine_size     (1U<<k_fxmodfm_sine_size_exp)
+#define k_fxmodfm_sine_u32shift (32-k_fxmodfm_sine_size_exp)
+#define k_fxmodfm_exp_size_exp  (8)
+#define k_fxmodfm_exp_size      (1U<<k_fxmodfm_exp_size_exp)
+
+// interpolation weights, in q14
+#define k_fxmodfm_one_q14       (1<<14)
+
+namespace dsp {
+
+  /**
+   * Tables of q15 pairs (t[i] low, t[i+1] high), so that one SMUAD
+   * with the weights (1 - f, f) interpolates between neighbours.
+   * The exp table is 2^-(i/256) just under 1.0, as q15 cannot hold
+   * it. Static members of a class template: one copy per unit,
+   * shared by all its files
+   */
+  template<class T>
+  struct FixedModFMTables {
+    static simd32_t sine_lut[k_fxmodfm_sine_size];
+    static simd32_t exp_lut[k_fxmodfm_exp_size];
+  };
+
+  template<class T>
+  simd32_t FixedModFMTables<T>::sine_lut[k_fxmodfm_sine_size];
+
+  template<class T>
+  simd32_t FixedModFMTables<T>::exp_lut[k_fxmodfm_exp_size];
+
+  /**
+   * Fixed-point ModFM kernel, exp(r k (cos(pm) - 1)) cos(pc + s k sin(pm)),
+   * for phases where a full period is 2^32
+   */
+  struct FixedModFM : FixedModFMTables<FixedModFM> {
+
+    /**
+     * Fill the tables: quarter sine by recurrence, in double,
+     * the rest by symmetry; exp by repeated products
+     */
+    static void init(void) {
+      const uint32_t q = k_fxmodfm_sine_size >> 2;
+      int16_t t[k_fxmodfm_sine_size + 1];
+      const double c = 1.9999623505652022; // 2*cos(2*pi/1024)
+      double s0 = 0., s1 = 0.006135884649154475;
+      for (uint32_t i = 0; i < q; i++) {
+        const double s = c * s1 - s0;
+        t[i] = (int16_t) (s0 * 32767. + .5);
+        s0 = s1;
+        s1 = s;
+      }
+      t[q] = 32767;
+      for (uint32_t i = 0; i < q; i++)
+        t[2*q-i] = t[i];
+      for (uint32_t i = 0; i < 2*q; i++)
+        t[2*q+i] = -t[i];
+      t[4*q] = 0;
+      for (uint32_t i = 0; i < k_fxmodfm_sine_size; i++)
+        sine_lut[i] = pkhbt(t[i], t[i+1], 16);
+
+      const double g = 0.99729605608547012; // 2^-(1/256)
+      double e = 32767.;
+      for (uint32_t i = 0; i < k_fxmodfm_exp_size; i++) {
+        const int32_t e0 = (int32_t) (e + .5);
+        e *= g;
+        exp_lut[i] = pkhbt(e0, (int32_t) (e + .5), 16);
+      }
+    }
+
+    /**
+     * Weights (1 - f, f) for a q14 fraction f
+     */
+    static inline __attribute__((optimize("Ofast"),always_inline))
+    simd32_t weights(uint32_t f) {
+      return pkhbt(k_fxmodfm_one_q14 - f, f, 16);
+    }
+
+    /**
+     * sin(2 pi x / 2^32), q15
+     */
+    static inline __attribute__((optimize("Ofast"),always_inline))
+    q15_t sin(uint32_t x) {
+      const simd32_t w = weights((x >> (k_fxmodfm_sine_u32shift - 14)) &
+                                 (k_fxmodfm_one_q14 - 1));
+      return (int32_t) smuad(sine_lut[x >> k_fxmodfm_sine_u32shift],
+                             w) >> 14;
+    }
+
+    /**
+     * cos(2 pi x / 2^32), q15
+     */
+    static inline __attribute__((optimize("Ofast"),always_inline))
+    q15_t cos(uint32_t x) {
+      return sin(x + (1U << 30));
+    }
+
+    /**
+     * Modulator amplitude, exp(k (c - 1)) as 2^-(kl (1 - c)),
+     * q15: the fraction of the exponent from the table, the
+     * integral part as a shift
+     *
+     * @param kl Index times log2(e), q16.16, >= 0
+     * @param c  Modulator cosine, q15
+     */
+    static inline __attribute__((optimize("Ofast"),always_inline))
+    q15_t amp(q15_16_t kl, q15_t c) {
+      const uint32_t x =
+        (uint32_t) (((q63_t) kl * (32768 - c)) >> 15); // q16.16
+      const uint32_t n = x >> 16;
+      if (n > 15) return 0;
+      const simd32_t w = weights((x & 0xFF) << 6);
+      return (int32_t) smuad(exp_lut[(x >> 8) &
+                                             (k_fxmodfm_exp_size - 1)], w)
+        >> (14 + n);
+    }
+
+    /**
+     * Carrier cosine, phase modulated by sk sin(pm), q15
+     *
+     * @param pc Carrier phase
+     * @param sk Phase modulation depth, s k / 2 pi, q16.16 cycles
+     * @param sm Modulator sine, q15
+     */
+    static inline __attribute__((optimize("Ofast"),always_inline))
+    q15_t carrier(uint32_t pc, q15_16_t sk, q15_t sm) {
+      return cos(pc + (uint32_t) ((q63_t) sk * sm * 2));
+    }
+
+    /**
+     * Phase as a fraction of 2^32, from cycles, 0 - 1
+     */
+    static inline __attribute__((always_inline))
+    uint32_t phase(float x) {
+      return (uint32_t) (int64_t) (x * 4294967296.f);
+    }
+
+    /**
+     * Phase in cycles, 0 - 1
+     */
+    static inline __attribute__((always_inline))
+    float cycles(uint32_t x) {
+      return x * 2.32830643653870e-010f;
+    }
+  };
+}
+
+/** @} */
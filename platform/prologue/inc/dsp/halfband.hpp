@@ -0,0 +1,106 @@
+#pragma once
+/*  Polyphase IIR half-band decimator
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    halfband.hpp
+ * @brief   2x decimator built from a pair of allpass chains.
+ *
+ * @addtogroup dsp DSP
+ * @{
+ */
+
+#include <stdint.h>
+#include "biquad.hpp"
+
+namespace dsp {
+
+  /**
+   * Half-band lowpass and 2x decimator
+   *
+   * H(z) = (A0(z^2) + z^-1 A1(z^2)) / 2, with each path a chain of
+   * first order allpass sections running at the low rate.
+   * Elliptic design, 6 coefficients, transition band 0.45 - 0.55
+   * of the output rate, stopband better than -80 dB.
+   */
+  struct HalfBandDecimator {
+
+    enum {
+      k_stages = 3
+    };
+
+    /**
+     * Default constructor
+     */
+    HalfBandDecimator(void) : mX1(0) {
+      static const float a[2*k_stages] = {
+        0.06029739f, 0.21597144f, 0.41259072f,
+        0.60435863f, 0.77271565f, 0.92388614f
+      };
+      for (int k = 0; k < k_stages; k++) {
+        setAP(mPath0[k].mCoeffs, a[2*k]);
+        setAP(mPath1[k].mCoeffs, a[2*k+1]);
+      }
+    }
+
+    /**
+     * Flush internal delays
+     */
+    inline __attribute__((optimize("Ofast"),always_inline))
+    void flush(void) {
+      for (int k = 0; k < k_stages; k++) {
+        mPath0[k].flush();
+        mPath1[k].flush();
+      }
+      mX1 = 0;
+    }
+
+    /**
+     * Decimate a block
+     *
+     * @param x   Input, 2*n samples
+     * @param y   Output, n samples, may alias x
+     * @param n   Output sample count
+     */
+    inline __attribute__((optimize("Ofast")))
+    void process(const float *x, float *y, uint32_t n) {
+      for (uint32_t i = 0; i < n; i++) {
+        // even samples to path 0, odd samples a sample later to path 1
+        float e = x[2*i], o = mX1;
+        mX1 = x[2*i+1];
+        // the two paths are independent and interleave well
+        for (int k = 0; k < k_stages; k++) {
+          e = mPath0[k].process_fo(e);
+          o = mPath1[k].process_fo(o);
+        }
+        y[i] = 0.5f * (e + o);
+      }
+    }
+
+    // (a + z^-1) / (1 + a z^-1)
+    static void setAP(BiQuad::Coeffs &c, float a) {
+      c.ff0 = c.fb1 = a;
+      c.ff1 = 1.f;
+      c.ff2 = c.fb2 = 0.f;
+    }
+
+    BiQuad mPath0[k_stages], mPath1[k_stages];
+    float mX1;
+  };
+}
+
+/** @} */
@@ -0,0 +1,275 @@
+#pragma once
+/*  Math approximation policies
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    mathpolicy.hpp
+ * @brief   exp, pow2, pow, log2 and sin/cos approximations, selected
+ *          as template parameters.
+ *
+ * @addtogroup dsp DSP
+ * @{
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "userosc.h"
+
+// full-wave sine table: 1024 points, 2^32 phases shifted to
+// the index and a 22-bit fraction
+#define k_wt_sine_full_size_exp (10)
+#define k_wt_sine_full_size     (1U<<k_wt_sine_full_size_exp)
+#define k_wt_sine_full_u32shift (32-k_wt_sine_full_size_exp)
+#define k_wt_sine_full_frrecip  (2.38418579101562e-007f) // 1/(1<<22)
+#define k_wt_sine_full_mask     (k_wt_sine_full_size-1)
+#define k_wt_sine_full_lut_size (k_wt_sine_full_size+1)
+
+namespace dsp {
+
+  /**
+   * Policy tags:
+   *
+   * Fast      - Mineiro's fast approximations (float_math.h)
+   * Faster    - the faster, coarser ones
+   * Table     - interpolated 33-point tables over one octave
+   * Reference - libm, for offline renders
+   *
+   * All but Reference take sin/cos from a SineLookup.
+   * Phases are in cycles, as for osc_sinf().
+   */
+  struct Fast {};
+  struct Faster {};
+  struct Table {};
+  struct Reference {};
+
+  /**
+   * Sine lookup tags:
+   *
+   * Firmware - the 128-point half-wave table, osc_sinf()
+   * Full     - the 1024-point full-wave table in unit SRAM,
+   *            SineLookup<Full>
+   */
+  struct Firmware {};
+  struct Full {};
+
+  template<class S> struct SineLookup;
+
+  template<>
+  struct SineLookup<Firmware> {
+    static void init(void) { }
+    static inline __attribute__((always_inline))
+    float cos(float x) { return osc_cosf(x); }
+    static inline __attribute__((always_inline))
+    float sin(float x) { return osc_sinf(x); }
+    static inline __attribute__((always_inline))
+    f32pair_t sincos(float x) { return osc_sincosf(x); }
+  };
+
+  /**
+   * Full-wave sine table storage: a static member of a class
+   * template, so that all the files of a unit share one copy,
+   * and units that do not use it get none
+   */
+  template<class T>
+  struct SineTable {
+    static float lut[k_wt_sine_full_lut_size];
+  };
+
+  template<class T>
+  float SineTable<T>::lut[k_wt_sine_full_lut_size];
+
+  /**
+   * Full-wave lookup: no sign branch and a finer grid than the
+   * firmware half-wave; init() fills the table
+   */
+  template<>
+  struct SineLookup<Full> : SineTable<Full> {
+
+    /**
+     * Quarter wave by recurrence, in double, the rest by symmetry
+     */
+    static void init(void) {
+      const uint32_t q = k_wt_sine_full_size >> 2;
+      const double c = 1.9999623505652022; // 2*cos(2*pi/1024)
+      double s0 = 0., s1 = 0.006135884649154475;
+      for (uint32_t i = 0; i < q; i++) {
+        const double s = c * s1 - s0;
+        lut[i] = (float)s0;
+        s0 = s1;
+        s1 = s;
+      }
+      lut[q] = 1.f;
+      for (uint32_t i = 0; i < q; i++)
+        lut[2*q-i] = lut[i];
+      for (uint32_t i = 0; i < 2*q; i++)
+        lut[2*q+i] = -lut[i];
+      lut[4*q] = 0.f;
+    }
+
+    /**
+     * sin(2 pi x), x in cycles
+     */
+    static inline __attribute__((always_inline))
+    float sin(float x) {
+      const float p = x - (uint32_t)x;
+      const float x0f = p * k_wt_sine_full_size;
+      const uint32_t x0 = (uint32_t)x0f;
+      return linintf(x0f - x0, lut[x0], lut[x0+1]);
+    }
+
+    static inline __attribute__((always_inline))
+    float cos(float x) { return sin(x+0.25f); }
+
+    /**
+     * sin(2 pi x) in a, cos(2 pi x) in b
+     */
+    static inline __attribute__((always_inline))
+    f32pair_t sincos(float x) {
+      const float p = x - (uint32_t)x;
+      const float x0f = p * k_wt_sine_full_size;
+      const uint32_t s0 = (uint32_t)x0f;
+      const uint32_t c0 = (s0 + (k_wt_sine_full_size>>2)) & k_wt_sine_full_mask;
+      const float fr = x0f - s0;
+      return f32pair(linintf(fr, lut[s0], lut[s0+1]),
+                     linintf(fr, lut[c0], lut[c0+1]));
+    }
+
+    /**
+     * sin(2 pi x), a full period being 2^32
+     */
+    static inline __attribute__((always_inline))
+    float sinu(uint32_t x) {
+      const uint32_t x0 = x >> k_wt_sine_full_u32shift;
+      const float fr = (x & ((1U<<k_wt_sine_full_u32shift)-1)) *
+        k_wt_sine_full_frrecip;
+      return linintf(fr, lut[x0], lut[x0+1]);
+    }
+
+    static inline __attribute__((always_inline))
+    float cosu(uint32_t x) { return sinu(x+(1U<<30)); }
+  };
+
+  /**
+   * P is the approximation tag, S the sine lookup tag; init()
+   * fills any table the policy needs
+   */
+  template<class P, class S = Firmware> struct MathPolicy;
+
+  template<class S>
+  struct MathPolicy<Fast, S> : SineLookup<S> {
+    static inline __attribute__((always_inline))
+    float exp(float x) { return fastexpf(x); }
+    static inline __attribute__((always_inline))
+    float pow2(float x) { return fastpow2f(x); }
+    static inline __attribute__((always_inline))
+    float pow(float x, float y) { return fastpowf(x, y); }
+    static inline __attribute__((always_inline))
+    float log2(float x) { return fastlog2f(x); }
+  };
+
+  template<class S>
+  struct MathPolicy<Faster, S> : SineLookup<S> {
+    static inline __attribute__((always_inline))
+    float exp(float x) { return fasterexpf(x); }
+    static inline __attribute__((always_inline))
+    float pow2(float x) { return fasterpow2f(x); }
+    static inline __attribute__((always_inline))
+    float pow(float x, float y) { return fasterpowf(x, y); }
+    static inline __attribute__((always_inline))
+    float log2(float x) { return fasterlog2f(x); }
+  };
+
+  template<class S>
+  struct MathPolicy<Table, S> : SineLookup<S> {
+
+    enum {
+      k_size_exp = 5,
+      k_size = 1 << k_size_exp
+    };
+
+    /**
+     * 2^x, -126 <= x < 128: the fraction from the table,
+     * the integral part added to the exponent
+     */
+    static inline __attribute__((always_inline))
+    float pow2(float x) {
+      static const float t[k_size+1] = {
+        1.000000000f, 1.021897149f, 1.044273782f, 1.067140401f,
+        1.090507733f, 1.114386743f, 1.138788635f, 1.163724859f,
+        1.189207115f, 1.215247360f, 1.241857812f, 1.269050957f,
+        1.296839555f, 1.325236643f, 1.354255547f, 1.383909882f,
+        1.414213562f, 1.445180807f, 1.476826146f, 1.509164428f,
+        1.542210825f, 1.575980845f, 1.610490332f, 1.645755478f,
+        1.681792831f, 1.718619298f, 1.756252160f, 1.794709075f,
+        1.834008086f, 1.874167634f, 1.915206561f, 1.957144124f,
+        2.000000000f
+      };
+      // offset by 126 octaves, so the truncation is a floor
+      const float xf = ((x < -126.f ? -126.f : x) + 126.f) * k_size;
+      const uint32_t k = (uint32_t) xf, i = k & (k_size - 1);
+      union { float f; uint32_t i; } v = { t[i] + (xf - k)*(t[i+1] - t[i]) };
+      v.i += ((k >> k_size_exp) - 126) << 23;
+      return v.f;
+    }
+
+    static inline __attribute__((always_inline))
+    float exp(float x) { return pow2(1.442695040f * x); }
+
+    /**
+     * log2(x), x > 0: the exponent, plus the mantissa
+     * from the table, indexed by its top bits
+     */
+    static inline __attribute__((always_inline))
+    float log2(float x) {
+      static const float t[k_size+1] = {
+        0.000000000f, 0.044394119f, 0.087462841f, 0.129283017f,
+        0.169925001f, 0.209453366f, 0.247927513f, 0.285402219f,
+        0.321928095f, 0.357552005f, 0.392317423f, 0.426264755f,
+        0.459431619f, 0.491853096f, 0.523561956f, 0.554588852f,
+        0.584962501f, 0.614709844f, 0.643856190f, 0.672425342f,
+        0.700439718f, 0.727920455f, 0.754887502f, 0.781359714f,
+        0.807354922f, 0.832890014f, 0.857980995f, 0.882643049f,
+        0.906890596f, 0.930737338f, 0.954196310f, 0.977279923f,
+        1.000000000f
+      };
+      const union { float f; uint32_t i; } v = { x };
+      const uint32_t i = (v.i >> (23 - k_size_exp)) & (k_size - 1);
+      const float a = (v.i & ((1U << (23 - k_size_exp)) - 1)) *
+        (1.f / (1U << (23 - k_size_exp)));
+      return (float) ((int32_t) (v.i >> 23) - 127) + t[i] + a*(t[i+1] - t[i]);
+    }
+
+    static inline __attribute__((always_inline))
+    float pow(float x, float y) { return pow2(y * log2(x)); }
+  };
+
+  template<class S>
+  struct MathPolicy<Reference, S> {
+    static void init(void) { }
+    static inline float exp(float x) { return expf(x); }
+    static inline float pow2(float x) { return exp2f(x); }
+    static inline float pow(float x, float y) { return powf(x, y); }
+    static inline float log2(float x) { return log2f(x); }
+    static inline float cos(float x) { return cosf(M_TWOPI * x); }
+    static inline float sin(float x) { return sinf(M_TWOPI * x); }
+    static inline f32pair_t sincos(float x) {
+      return f32pair(sin(x), cos(x));
+    }
+  };
+}
+
+/** @} */
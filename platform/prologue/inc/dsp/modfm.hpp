@@ -0,0 +1,417 @@
+#pragma once
+/*  ModFM building blocks
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    modfm.hpp
+ * @brief   Phase accumulator, ADSR envelope and ModFM operator shared
+ *          by the ModFM oscillators.
+ *
+ * @addtogroup dsp DSP
+ * @{
+ */
+
+#include <stdint.h>
+#include "userosc.h"
+#include "mathpolicy.hpp"
+
+// approximation policy of the units: Fast, Faster, Table
+// or Reference
+#ifndef MODFM_MATH
+#define MODFM_MATH Faster
+#endif
+
+// sine lookup: Firmware or Full
+#ifndef MODFM_SINE
+#define MODFM_SINE Firmware
+#endif
+
+// envelope decay time and sustain level, 0 - 100% as the menu
+// attack and release: set at build time, the menu being full,
+// and with extended parameters on the host
+#ifndef MODFM_ENV_DECAY
+#define MODFM_ENV_DECAY (0)
+#endif
+#ifndef MODFM_ENV_SUSTAIN
+#define MODFM_ENV_SUSTAIN (100)
+#endif
+
+// curves of the envelope segments, as the fraction of each left
+// to its target at the breakpoint, and their log2: smaller is
+// more curved
+#define k_env_attack_curve (0.25f)
+#define k_env_attack_log2  (-2.f)
+#define k_env_decay_curve  (0.03125f)
+#define k_env_decay_log2   (-5.f)
+#define k_env_forever      (0xFFFFFFFFU)
+
+// span of the units' sub-blocks, whose factor is kept per segment
+#define k_env_block        (16)
+
+namespace dsp {
+
+  typedef MathPolicy<MODFM_MATH, MODFM_SINE> UnitMath;
+
+  /**
+   * Phase accumulator, in cycles (0 - 1)
+   */
+  struct PhaseAccumulator {
+
+    PhaseAccumulator(void) : mPhase(0.f), mW0(0.f) { }
+
+    PhaseAccumulator(float phase, float w0) : mPhase(phase), mW0(w0) { }
+
+    inline __attribute__((always_inline))
+    void flush(void) { mPhase = 0.f; }
+
+    /**
+     * Set the increment
+     *
+     * @param w0 Frequency in cycles per sample, 0 - 1
+     */
+    inline __attribute__((always_inline))
+    void setW0(float w0) { mW0 = w0; }
+
+    /**
+     * Current phase, then step one sample
+     */
+    inline __attribute__((always_inline))
+    float process(void) {
+      const float p = mPhase;
+      advance(mPhase, mW0);
+      return p;
+    }
+
+    /**
+     * Step a phase held elsewhere, w in 0 - 1
+     */
+    static inline __attribute__((always_inline))
+    void advance(float &ph, float w) {
+      ph += w;
+      ph -= (uint32_t) ph;
+    }
+
+    /**
+     * Wrap a phase of either sign into 0 - 1
+     */
+    static inline __attribute__((always_inline))
+    float wrap(float ph) {
+      return ph < 0.f ? ph - floor(ph) : ph - (uint32_t) ph;
+    }
+
+    float mPhase, mW0;
+  };
+
+  /**
+   * ADSR envelope with exponential segments. Each segment heads
+   * for a target past its breakpoint, so that the distance left
+   * falls by a constant factor per frame, d = d + d k with
+   * k = c - 1, and reaches k_env_attack_curve (attack) or
+   * k_env_decay_curve (decay and release) of the segment at
+   * the breakpoint, where the level is set to it exactly.
+   *
+   * The distance is the state, and k is derived at the note-on
+   * with expm1f, as c is too close to 1 for a float over long
+   * segments; the same holds for the factor of a sub-block,
+   * k_env_block frames, kept per segment, while other spans
+   * derive theirs as they come. The release target is set at
+   * the note-off, from the level then.
+   *
+   * Callers render in spans between breakpoints: span() gives
+   * the frames of a block up to the next one, tick() steps a
+   * frame within it and skip() closes it; proc(n) advances n
+   * frames at once
+   */
+  struct ADSREnvelope {
+
+    enum {
+      k_attack = 0,
+      k_decay,
+      k_sustain,
+      k_release,
+      k_idle
+    };
+
+    ADSREnvelope(void) :
+      mE(0.f), mT(0.f), mD(0.f), mK(0.f), mKb(0.f), mL(0.f),
+      mLeft(k_env_forever), mStage(k_idle), mS(1.f),
+      mLa(0.f), mLd(0.f), mLr(0.f), mKa(0.f), mKd(0.f), mKr(0.f),
+      mKab(0.f), mKdb(0.f), mKrb(0.f), mNa(0), mNd(0), mNr(0),
+      mHold(false) { }
+
+    /**
+     * Start the attack
+     *
+     * @param att  Attack time (s), 0 for none
+     * @param dcy  Decay time (s), 0 for none
+     * @param sus  Sustain level, 0 - 1
+     * @param rel  Release time (s), 0 for none
+     * @param hold With a zero release time, go to full level at
+     *             the release and hold it
+     */
+    void init(float att, float dcy, float sus, float rel, bool hold = false) {
+      mNa = frames(att);
+      mNd = frames(dcy);
+      mNr = frames(rel);
+      mLa = mNa ? k_env_attack_log2 / mNa : 0.f;
+      mLd = mNd ? k_env_decay_log2 / mNd : 0.f;
+      mLr = mNr ? k_env_decay_log2 / mNr : 0.f;
+      mKa = factor(mLa, 1);
+      mKd = factor(mLd, 1);
+      mKr = factor(mLr, 1);
+      mKab = factor(mLa, k_env_block);
+      mKdb = factor(mLd, k_env_block);
+      mKrb = factor(mLr, k_env_block);
+      mS = sus;
+      mHold = hold;
+      mE = 0.f;
+      enter(k_attack);
+    }
+
+    /**
+     * Start the release, from the current level
+     */
+    void release(void) {
+      if (mStage == k_idle) return;
+      if (mNr || !mHold) {
+        enter(k_release);
+        return;
+      }
+      mE = 1.f;
+      enter(k_sustain);
+    }
+
+    /**
+     * Frames of the next n up to the next breakpoint
+     */
+    uint32_t span(uint32_t n) const { return n < mLeft ? n : mLeft; }
+
+    /**
+     * Step one frame, within a span
+     */
+    inline __attribute__((always_inline))
+    float tick(void) {
+      mD += mD * mK;
+      return (mE = mT + mD);
+    }
+
+    /**
+     * Close a span of n frames, moving on at a breakpoint
+     */
+    void skip(uint32_t n) {
+      if ((mLeft -= n) == 0) next();
+    }
+
+    /**
+     * Advance n frames at once
+     */
+    float proc(uint32_t n) {
+      while (n) {
+        const uint32_t len = span(n);
+        mD += mD * (len == k_env_block ? mKb : factor(mL, len));
+        mE = mT + mD;
+        skip(len);
+        n -= len;
+      }
+      return mE;
+    }
+
+    /**
+     * Highest level over the next n frames: segments are
+     * monotonic, so it is at either end or a breakpoint
+     */
+    float peak(uint32_t n) const {
+      ADSREnvelope e = *this;
+      float p = mE;
+      while (n) {
+        const uint32_t len = e.span(n);
+        e.proc(len);
+        p = e.mE > p ? e.mE : p;
+        n -= len;
+      }
+      return p;
+    }
+
+    float val(void) const { return mE; }
+
+    static uint32_t frames(float secs) {
+      return secs > 0.f ? (uint32_t) (secs * k_samplerate + .5f) : 0;
+    }
+
+    // 2^(l n) - 1, for the distance over n frames
+    static float factor(float l, uint32_t n) {
+      return l != 0.f ? expm1f(0.6931471806f * l * n) : 0.f;
+    }
+
+    // set up a segment, falling through those of no length
+    void enter(int stage) {
+      switch (mStage = stage) {
+      case k_attack:
+        if (mNa) {
+          segment(1.f / (1.f - k_env_attack_curve), mLa, mKa, mKab, mNa);
+          break;
+        }
+        mE = 1.f;
+        mStage = k_decay;
+        // fall through
+      case k_decay:
+        if (mNd && mS < 1.f) {
+          segment((mS - k_env_decay_curve) / (1.f - k_env_decay_curve),
+                  mLd, mKd, mKdb, mNd);
+          break;
+        }
+        mE = mS;
+        mStage = k_sustain;
+        // fall through
+      case k_sustain:
+        segment(mE, 0.f, 0.f, 0.f, k_env_forever);
+        break;
+      case k_release:
+        if (mNr) {
+          segment(-k_env_decay_curve * mE / (1.f - k_env_decay_curve),
+                  mLr, mKr, mKrb, mNr);
+          break;
+        }
+        mE = 0.f;
+        mStage = k_idle;
+        // fall through
+      default:
+        segment(mE, 0.f, 0.f, 0.f, k_env_forever);
+        break;
+      }
+    }
+
+    // land on the breakpoint and enter the next segment
+    void next(void) {
+      switch (mStage) {
+      case k_attack:
+        mE = 1.f;
+        enter(k_decay);
+        break;
+      case k_decay:
+        mE = mS;
+        enter(k_sustain);
+        break;
+      case k_release:
+        mE = 0.f;
+        enter(k_idle);
+        break;
+      default:
+        mLeft = k_env_forever;
+        break;
+      }
+    }
+
+    void segment(float t, float l, float k, float kb, uint32_t n) {
+      mT = t;
+      mD = mE - t;
+      mL = l;
+      mK = k;
+      mKb = kb;
+      mLeft = n;
+    }
+
+    float mE;           // level
+    float mT, mD;       // segment target and distance to it
+    float mK, mKb, mL;  // factors per frame and sub-block, log2 per frame
+    uint32_t mLeft;     // frames to the breakpoint
+    int mStage;
+    float mS;           // sustain level
+    float mLa, mLd, mLr; // set at the note-on
+    float mKa, mKd, mKr;
+    float mKab, mKdb, mKrb;
+    uint32_t mNa, mNd, mNr; // segment lengths (frames)
+    bool mHold;
+  };
+
+  /**
+   * Peak level of the ModFM operator: the Faster exp is 0.971
+   * at 0, which keeps a full-level kernel under full scale;
+   * the other policies are scaled to match it
+   */
+  template<class M>
+  struct ModFMLevel {
+    static float value(void) { return 0.9713475f; }
+  };
+
+  template<class S>
+  struct ModFMLevel<MathPolicy<Faster, S> > {
+    static float value(void) { return 1.f; }
+  };
+
+  /**
+   * ModFM operator: cos(pc) exp(k (cos(pm) - 1)), with the
+   * carrier optionally between two adjacent harmonics;
+   * M is the approximation policy
+   */
+  template<class M>
+  struct ModFMOperator {
+
+    /**
+     * exp(x) at the operator's level, for x <= 0
+     */
+    static inline __attribute__((always_inline))
+    float exp(float x) {
+      return ModFMLevel<M>::value() * M::exp(x);
+    }
+
+    /**
+     * Modulator amplitude term
+     *
+     * @param k  Index of modulation
+     * @param cm Modulator cosine
+     */
+    static inline __attribute__((always_inline))
+    float amp(float k, float cm) {
+      return exp(k * (cm - 1.f));
+    }
+
+    /**
+     * Carrier interpolated between two harmonics
+     *
+     * @param a   Weight of the upper harmonic, 0 - 1
+     * @param pc1 Lower harmonic phase
+     * @param pc2 Upper harmonic phase
+     */
+    static inline __attribute__((always_inline))
+    float carrier(float a, float pc1, float pc2) {
+      return a * M::cos(pc2) + (1.f - a) * M::cos(pc1);
+    }
+
+    /**
+     * Operator with an interpolated carrier
+     */
+    static inline __attribute__((always_inline))
+    float process(float k, float a, float pc1, float pc2, float pm) {
+      return carrier(a, pc1, pc2) * amp(k, M::cos(pm));
+    }
+
+    /**
+     * Index giving a formant of bandwidth kbw
+     *
+     * @param fo  Fundamental (Hz)
+     * @param kbw Bandwidth (Hz)
+     */
+    static float index(float fo, float kbw) {
+      const float g = M::pow2(-fo / (.29f * kbw));
+      const float gm = 1.f - g;
+      return 2*g/(gm*gm);
+    }
+  };
+}
+
+/** @} */
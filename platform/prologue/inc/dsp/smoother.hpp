@@ -0,0 +1,152 @@
+#pragma once
+/*  Control-rate parameter smoothing
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    smoother.hpp
+ * @brief   Parameter and LFO smoothing, a sub-block at a time.
+ *
+ * @addtogroup dsp DSP
+ * @{
+ */
+
+#include <stdint.h>
+#include "userosc.h"
+#include "float_math.h"
+
+// distance from the target (or its log2) taken as there
+#define k_smooth_tol (1e-5f)
+
+namespace dsp {
+
+  /**
+   * Smoothing modes
+   */
+  enum {
+    k_smooth_linear = 0, // linear ramp to each new target
+    k_smooth_onepole,    // exponential approach (one-pole lowpass)
+    k_smooth_exp         // exponential approach in log2, for
+                         // positive values (frequencies, ratios)
+  };
+
+  /**
+   * Control smoother, advanced in steps of a sub-block or block
+   *
+   * Each step moves the value to its next breakpoint and returns
+   * the increment per frame that gets there, so that the caller
+   * ramps it linearly at the same cost whether it moves or not.
+   * The mode is fixed at compile time.
+   */
+  template<int M>
+  struct Smoother {
+
+    /**
+     * Constructor, with no smoothing until time() is set
+     *
+     * @param x Initial value, positive for k_smooth_exp
+     */
+    Smoother(float x = 0.f) :
+      mX(x), mY(x), mLX(0.f), mLY(0.f), mT(0.f), mN(0.f), mK(-126.f) {
+      if (M == k_smooth_exp) mLX = mLY = fastlog2f(x);
+    }
+
+    /**
+     * Set the smoothing time, the ramp time for k_smooth_linear
+     * and the time constant otherwise. It depends on the sample
+     * rate, so set it at init.
+     *
+     * @param secs Time (s), 0 for none
+     */
+    void time(float secs) {
+      if (M == k_smooth_linear)
+        mT = secs * k_samplerate;
+      else // log2 of the decay per frame
+        mK = secs > 0.f ? -1.442695041f / (secs * k_samplerate) : -126.f;
+    }
+
+    /**
+     * Set a new target
+     */
+    void set(float x) {
+      mX = x;
+      if (M == k_smooth_linear)
+        mN = mT;
+      else if (M == k_smooth_exp)
+        mLX = fastlog2f(x);
+    }
+
+    /**
+     * Set a new target, reached in n frames (k_smooth_linear):
+     * a block-rate control, such as the shape LFO, ramped over
+     * the block
+     */
+    void set(float x, uint32_t n) {
+      mX = x;
+      mN = n;
+    }
+
+    /**
+     * Jump to a value
+     */
+    void reset(float x) {
+      mX = mY = x;
+      if (M == k_smooth_exp) mLX = mLY = fastlog2f(x);
+    }
+
+    /**
+     * Advance n frames, to the next breakpoint
+     *
+     * @param n Frames, > 0
+     * @return  Increment per frame
+     */
+    inline __attribute__((optimize("Ofast"),always_inline))
+    float step(uint32_t n) {
+      if (mY == mX) return 0.f;
+      const float y0 = mY;
+      if (M == k_smooth_linear) {
+        if (n < mN) {
+          mY += (mX - mY) * (n / mN);
+          mN -= n;
+        } else
+          mY = mX;
+      } else {
+        const float g = 1.f - fastpow2f(mK * n);
+        if (M == k_smooth_onepole) {
+          mY += (mX - mY) * g;
+          if (fabsf(mX - mY) < k_smooth_tol) mY = mX;
+        } else {
+          mLY += (mLX - mLY) * g;
+          if (fabsf(mLX - mLY) < k_smooth_tol) mLY = mLX;
+          mY = mLY == mLX ? mX : fastpow2f(mLY);
+        }
+      }
+      return (mY - y0) * (1.f / n);
+    }
+
+    float val(void) const { return mY; }
+
+    float target(void) const { return mX; }
+
+    float mX, mY;   // target, value
+    float mLX, mLY; // their log2 (k_smooth_exp)
+    float mT, mN;   // ramp time and frames left (k_smooth_linear)
+    float mK;       // log2 of the decay per frame
+  };
+
+}
+
+/** @} */
@@ -84,8 +84,20 @@ extern "C" {
     return _osc_mcu_hash();
   }
 
+#ifdef OSC_HOST
+  /**
+   * Host builds render at any rate, set once by osc_host_init()
+   * before the unit's init hook.
+   */
+  extern uint32_t osc_host_samplerate;
+  extern float osc_host_samplerate_recipf;
+
+#define k_samplerate        (osc_host_samplerate)
+#define k_samplerate_recipf (osc_host_samplerate_recipf)
+#else
 #define k_samplerate        (48000)
 #define k_samplerate_recipf (2.08333333333333e-005f)
+#endif
 
   /** @} */
   
@@ -176,7 +188,67 @@ extern "C" {
   __fast_inline float osc_cosf(float x) {
     return osc_sinf(x+0.25f);
   }
-  
+
+  /**
+   * Lookup values of sin(2*pi*x) and cos(2*pi*x).
+   *
+   * @note Single wrap and index computation, cosine read a quarter
+   *       period ahead in the same half-wave table.
+   *
+   * @param   x  Phase ratio
+   * @return     Pair with sin(2*pi*x) in a and cos(2*pi*x) in b.
+   */
+  __fast_inline f32pair_t osc_sincosf(float x) {
+    const float p = x - (uint32_t)x;
+
+    const float x0f = 2.f * p * k_wt_sine_size;
+    const uint32_t x0p = (uint32_t)x0f;
+    const uint32_t xcp = (x0p + (k_wt_sine_size>>1)) & ((k_wt_sine_size<<1)-1);
+    const float fr = x0f - x0p;
+
+    const uint32_t s0 = x0p & k_wt_sine_mask;
+    const uint32_t c0 = xcp & k_wt_sine_mask;
+
+    const float ys = linintf(fr, wt_sine_lut_f[s0], wt_sine_lut_f[s0+1]);
+    const float yc = linintf(fr, wt_sine_lut_f[c0], wt_sine_lut_f[c0+1]);
+    return f32pair((x0p < k_wt_sine_size)?ys:-ys,
+                   (xcp < k_wt_sine_size)?yc:-yc);
+  }
+
+  /**
+   * Lookup value of sin(2*pi*x), 32-bit phase.
+   *
+   * @param   x  Phase, a full period is 2^32.
+   * @return     Result of sin(2*pi*x).
+   */
+  __fast_inline float osc_sinuf(uint32_t x) {
+    // top bit selects the half, the next 7 the point
+    const uint32_t x0 = (x >> k_wt_sine_u32shift) & k_wt_sine_mask;
+    const float fr = (x & ((1U<<k_wt_sine_u32shift)-1)) * k_wt_sine_frrecip;
+    const float y0 = linintf(fr, wt_sine_lut_f[x0], wt_sine_lut_f[x0+1]);
+    return (x < 0x80000000U)?y0:-y0;
+  }
+
+  /**
+   * Lookup value of cos(2*pi*x), 32-bit phase.
+   *
+   * @param   x  Phase, a full period is 2^32.
+   * @return     Result of cos(2*pi*x).
+   */
+  __fast_inline float osc_cosuf(uint32_t x) {
+    return osc_sinuf(x+((k_wt_sine_size>>1)<<k_wt_sine_u32shift));
+  }
+
+  /**
+   * Phase ratio to 32-bit phase.
+   *
+   * @param   x  Phase ratio in [0, 1.0).
+   * @return     Phase, a full period is 2^32.
+   */
+  __fast_inline uint32_t osc_phaseu(float x) {
+    return (uint32_t)(x * 4294967296.f);
+  }
+
   /** @} */
   
 /**
@@ -0,0 +1,147 @@
+/*  Hot-path stage timers for host builds
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    osc_prof.h
+ * @brief   Per-stage timers and counters inside a unit's hooks, for
+ *          host builds with OSC_PROF defined; they compile out
+ *          otherwise, and always on the prologue.
+ *
+ * A stage is a named static accumulator, one per call site; the
+ * host driver reports them, merged by name, at the end of a run
+ * (host/osc_prof.c). Timed stages read the hardware cycle and
+ * instruction counters through perf_event_open where the host
+ * allows it, the time stamp counter otherwise.
+ *
+ * @addtogroup osc Oscillator
+ * @{
+ */
+
+#ifndef __osc_prof_h
+#define __osc_prof_h
+
+#ifdef OSC_PROF
+
+#ifndef OSC_HOST
+#error "OSC_PROF is for host builds only"
+#endif
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct osc_prof_stage {
+    const char *name;
+    uint64_t calls, frames;
+    uint64_t count[2]; // cycles or ticks, instructions
+    int timed, listed;
+    struct osc_prof_stage *next;
+  } osc_prof_stage_t;
+
+#define OSC_PROF_STAGE(name) { (name), 0, 0, {0, 0}, 0, 0, 0 }
+
+  /**
+   * Open the counters. Called once by the host driver.
+   */
+  void osc_prof_init(void);
+
+  /**
+   * Read the counters.
+   */
+  void osc_prof_read(uint64_t v[2]);
+
+  /**
+   * Add the counts since v0 to a timed stage.
+   *
+   * @param s      Stage.
+   * @param v0     Counters at the start of the stage.
+   * @param frames Frames covered, 0 for none.
+   */
+  void osc_prof_add(osc_prof_stage_t *s, const uint64_t v0[2],
+                    uint32_t frames);
+
+  /**
+   * Count an event.
+   *
+   * @param s Stage.
+   * @param n Frames covered, 0 for none.
+   */
+  void osc_prof_count(osc_prof_stage_t *s, uint32_t n);
+
+  /**
+   * Print the stages, merged by name, to stderr. Called once by the
+   * host driver.
+   */
+  void osc_prof_report(void);
+
+#ifdef __cplusplus
+} // extern "C"
+
+  /**
+   * Stage timed from construction to destruction
+   */
+  struct osc_prof_scope {
+    osc_prof_scope(osc_prof_stage_t *s, uint32_t frames) :
+      stage(s), n(frames) { osc_prof_read(v); }
+    ~osc_prof_scope() { osc_prof_add(stage, v, n); }
+    osc_prof_stage_t *stage;
+    uint32_t n;
+    uint64_t v[2];
+  };
+
+#define OSC_PROF_CAT_(a, b) a##b
+#define OSC_PROF_CAT(a, b) OSC_PROF_CAT_(a, b)
+
+#define OSC_PROF_SCOPE(name, frames)                                    \
+  static osc_prof_stage_t OSC_PROF_CAT(osc_prof_s, __LINE__) =          \
+    OSC_PROF_STAGE(name);                                               \
+  osc_prof_scope OSC_PROF_CAT(osc_prof_t, __LINE__)                     \
+    (&OSC_PROF_CAT(osc_prof_s, __LINE__), frames)
+#endif
+
+#define OSC_PROF_BEGIN(id, name)                                        \
+  static osc_prof_stage_t osc_prof_s_##id = OSC_PROF_STAGE(name);       \
+  uint64_t osc_prof_v_##id[2];                                          \
+  osc_prof_read(osc_prof_v_##id)
+
+#define OSC_PROF_END(id, frames)                                        \
+  osc_prof_add(&osc_prof_s_##id, osc_prof_v_##id, frames)
+
+#define OSC_PROF_COUNT(name, frames)                                    \
+  do {                                                                  \
+    static osc_prof_stage_t osc_prof_c = OSC_PROF_STAGE(name);          \
+    osc_prof_count(&osc_prof_c, frames);                                \
+  } while (0)
+
+#else
+
+/** Time the rest of the enclosing block as stage name (C++) */
+#define OSC_PROF_SCOPE(name, frames)
+/** Start timing stage name, labelled id within the function */
+#define OSC_PROF_BEGIN(id, name)
+/** Stop timing stage id, covering frames */
+#define OSC_PROF_END(id, frames)
+/** Count an event, covering frames */
+#define OSC_PROF_COUNT(name, frames)
+
+#endif // OSC_PROF
+
+#endif // __osc_prof_h
+
+/** @} */
@@ -0,0 +1,286 @@
+/*  Oscillator hook call trace
+    Copyright 2020 Victor Lazzarini
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    osc_trace.h
+ * @brief   Compact binary log of the calls into a unit's hooks,
+ *          written by the tracing shim in tpl/_unit.c and by the host
+ *          driver, read by the host replayer.
+ *
+ * A trace is an 8-byte header, "OSCT" and the sample rate, then one
+ * record per call. A record is a tag byte, the call type in the low
+ * 3 bits and, for the calls taking user_osc_param_t, flags for the
+ * fields that changed since the previous such call; then those
+ * fields, little-endian, in flag order. Cycle records add the frame
+ * count when it changed. A block with a steady shape LFO is one
+ * byte, a moving one five. A unit data load on the host is recorded
+ * with the size and FNV-1a hash of the file, so that a replay can
+ * check it is given the same one.
+ *
+ * @addtogroup osc Oscillator
+ * @{
+ */
+
+#ifndef __osc_trace_h
+#define __osc_trace_h
+
+#include <stdint.h>
+#include <string.h>
+#include "userosc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define k_osc_trace_header_size (8)
+#define k_osc_trace_max_record  (20)
+
+  /**
+   * Call types
+   */
+  enum {
+    k_osc_trace_init = 0,
+    k_osc_trace_cycle,
+    k_osc_trace_on,
+    k_osc_trace_off,
+    k_osc_trace_mute,
+    k_osc_trace_value,
+    k_osc_trace_param,
+    k_osc_trace_data,  // host unit data load
+    k_osc_trace_type_mask = 0x07
+  };
+
+  /**
+   * Changed-field flags
+   */
+  enum {
+    k_osc_trace_lfo = 0x08,    // shape_lfo
+    k_osc_trace_pitch = 0x10,  // pitch
+    k_osc_trace_cutres = 0x20, // cutoff and resonance
+    k_osc_trace_rsvd = 0x40,   // reserved0[]
+    k_osc_trace_frames = 0x80  // cycle frame count
+  };
+
+  /**
+   * Decoded call
+   */
+  typedef struct osc_trace_record {
+    uint8_t type;
+    user_osc_param_t params;
+    uint32_t frames;
+    uint32_t a, b; // init platform and api, value, param index and
+                   // value, or data size and hash
+  } osc_trace_record_t;
+
+  /**
+   * Running state, the same on both sides
+   */
+  typedef struct osc_trace_state {
+    user_osc_param_t params;
+    uint32_t frames;
+  } osc_trace_state_t;
+
+  static inline void osc_trace_reset(osc_trace_state_t *s) {
+    memset(s, 0, sizeof(*s));
+    s->frames = 64;
+  }
+
+  static inline uint32_t osc_trace_put16(uint8_t *b, uint32_t v) {
+    b[0] = v & 0xFF;
+    b[1] = (v >> 8) & 0xFF;
+    return 2;
+  }
+
+  static inline uint32_t osc_trace_put32(uint8_t *b, uint32_t v) {
+    osc_trace_put16(b, v);
+    return 2 + osc_trace_put16(b + 2, v >> 16);
+  }
+
+  static inline uint32_t osc_trace_get16(const uint8_t *b) {
+    return b[0] | (b[1] << 8);
+  }
+
+  static inline uint32_t osc_trace_get32(const uint8_t *b) {
+    return osc_trace_get16(b) | (osc_trace_get16(b + 2) << 16);
+  }
+
+  /**
+   * FNV-1a hash, continued from h (2166136261 to start).
+   */
+  static inline uint32_t osc_trace_hash(uint32_t h, const uint8_t *b,
+                                        uint32_t n) {
+    for (uint32_t i = 0; i < n; i++)
+      h = (h ^ b[i]) * 16777619U;
+    return h;
+  }
+
+  /**
+   * Write the trace header.
+   *
+   * @param b     Output, k_osc_trace_header_size bytes.
+   * @param srate Sample rate (Hz).
+   * @return      Bytes written.
+   */
+  static inline uint32_t osc_trace_header(uint8_t *b, uint32_t srate) {
+    memcpy(b, "OSCT", 4);
+    return 4 + osc_trace_put32(b + 4, srate);
+  }
+
+  /**
+   * Encode a call.
+   *
+   * @param s      Running state.
+   * @param b      Output, at least k_osc_trace_max_record bytes.
+   * @param type   Call type.
+   * @param p      Parameters, for cycle, on, off and mute.
+   * @param frames Cycle frame count.
+   * @param x      Init platform, value, param index, or data size.
+   * @param y      Init api, param value, or data hash.
+   * @return       Bytes written.
+   */
+  static inline uint32_t osc_trace_encode(osc_trace_state_t *s, uint8_t *b,
+                                          uint8_t type,
+                                          const user_osc_param_t *p,
+                                          uint32_t frames,
+                                          uint32_t x, uint32_t y) {
+    uint32_t n = 1;
+    uint8_t tag = type;
+    switch (type) {
+    case k_osc_trace_init:
+    case k_osc_trace_data:
+      n += osc_trace_put32(b + n, x);
+      n += osc_trace_put32(b + n, y);
+      break;
+    case k_osc_trace_value:
+      n += osc_trace_put16(b + n, x);
+      break;
+    case k_osc_trace_param:
+      n += osc_trace_put16(b + n, x);
+      n += osc_trace_put16(b + n, y);
+      break;
+    default: {
+      user_osc_param_t *q = &s->params;
+      if (p->shape_lfo != q->shape_lfo) {
+        tag |= k_osc_trace_lfo;
+        n += osc_trace_put32(b + n, (uint32_t) p->shape_lfo);
+      }
+      if (p->pitch != q->pitch) {
+        tag |= k_osc_trace_pitch;
+        n += osc_trace_put16(b + n, p->pitch);
+      }
+      if (p->cutoff != q->cutoff || p->resonance != q->resonance) {
+        tag |= k_osc_trace_cutres;
+        n += osc_trace_put16(b + n, p->cutoff);
+        n += osc_trace_put16(b + n, p->resonance);
+      }
+      if (memcmp(p->reserved0, q->reserved0, sizeof(q->reserved0))) {
+        tag |= k_osc_trace_rsvd;
+        for (int i = 0; i < 3; i++)
+          n += osc_trace_put16(b + n, p->reserved0[i]);
+      }
+      if (type == k_osc_trace_cycle && frames != s->frames) {
+        tag |= k_osc_trace_frames;
+        n += osc_trace_put16(b + n, frames);
+        s->frames = frames;
+      }
+      *q = *p;
+    }
+    }
+    b[0] = tag;
+    return n;
+  }
+
+  /**
+   * Decode a call.
+   *
+   * @param s Running state.
+   * @param b Input.
+   * @param n Input bytes left.
+   * @param r Output record.
+   * @return  Bytes read, 0 for a truncated or malformed record.
+   */
+  static inline uint32_t osc_trace_decode(osc_trace_state_t *s,
+                                          const uint8_t *b, uint32_t n,
+                                          osc_trace_record_t *r) {
+    if (n == 0) return 0;
+    const uint8_t tag = b[0];
+    uint32_t k = 1, need = 1;
+    r->type = tag & k_osc_trace_type_mask;
+    switch (r->type) {
+    case k_osc_trace_init:
+    case k_osc_trace_data:
+      if (n < 9) return 0;
+      r->a = osc_trace_get32(b + 1);
+      r->b = osc_trace_get32(b + 5);
+      return 9;
+    case k_osc_trace_value:
+      if (n < 3) return 0;
+      r->a = osc_trace_get16(b + 1);
+      return 3;
+    case k_osc_trace_param:
+      if (n < 5) return 0;
+      r->a = osc_trace_get16(b + 1);
+      r->b = osc_trace_get16(b + 3);
+      return 5;
+    case k_osc_trace_cycle:
+    case k_osc_trace_on:
+    case k_osc_trace_off:
+    case k_osc_trace_mute:
+      break;
+    default:
+      return 0;
+    }
+    if (tag & k_osc_trace_lfo) need += 4;
+    if (tag & k_osc_trace_pitch) need += 2;
+    if (tag & k_osc_trace_cutres) need += 4;
+    if (tag & k_osc_trace_rsvd) need += 6;
+    if (tag & k_osc_trace_frames) need += 2;
+    if (n < need) return 0;
+    user_osc_param_t *q = &s->params;
+    if (tag & k_osc_trace_lfo) {
+      q->shape_lfo = (int32_t) osc_trace_get32(b + k);
+      k += 4;
+    }
+    if (tag & k_osc_trace_pitch) {
+      q->pitch = osc_trace_get16(b + k);
+      k += 2;
+    }
+    if (tag & k_osc_trace_cutres) {
+      q->cutoff = osc_trace_get16(b + k);
+      q->resonance = osc_trace_get16(b + k + 2);
+      k += 4;
+    }
+    if (tag & k_osc_trace_rsvd) {
+      for (int i = 0; i < 3; i++, k += 2)
+        q->reserved0[i] = osc_trace_get16(b + k);
+    }
+    if (tag & k_osc_trace_frames) {
+      s->frames = osc_trace_get16(b + k);
+      k += 2;
+    }
+    r->params = *q;
+    r->frames = s->frames;
+    return k;
+  }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // __osc_trace_h
+
+/** @} */
@@ -10,6 +10,13 @@ UCXXSRC = psmodfm.cpp
 
 UINCDIR =
 
+# Math approximations (Fast, Faster, Table or Reference, default Faster)
+# can be set with -DMODFM_MATH=name
+# The 1024-point sine table, in unit SRAM, is used with -DMODFM_SINE=Full
+# The envelope decay time and sustain level (0 - 100%, defaults 0 and 100)
+# are set with -DMODFM_ENV_DECAY=n and -DMODFM_ENV_SUSTAIN=n
+# Hook calls are logged for the host replayer with -DOSC_TRACE (see
+# host/README.md), into OSC_TRACE_SIZE bytes (default 4096)
 UDEFS =
 
 ULIB = 
@@ -16,128 +16,150 @@
 */
 
 #include "userosc.h"
-#define EXP(x) fasterexpf(x)
-#define POW(x, y) fasterpowf(x, y)
-#define POW2(x) fasterpow2f(x)
-
-// Simple linear AR envelope
-struct Env {
-  float atti, deci, e;
-  bool dflg;
-
-  Env() : atti(1), deci(1), e(0.), dflg(false) { };
-
-  float init(float att, float dec) {
-    e = 0.f;
-    atti = att > 0.f ? 1.f / (att * k_samplerate) : (e = 1.f);
-    deci = dec > 0.f ? 1.f / (dec * k_samplerate) : 1.f;
-    dflg = false;
-  }
+#include "modfm.hpp"
+#include "smoother.hpp"
+#include "osc_prof.h"
 
-  void decay() { dflg = true; }
+typedef dsp::UnitMath Math;
+typedef dsp::ModFMOperator<Math> ModFMOp;
 
-  float proc() {
-    return (e = !dflg ? (e < 1.f ? e + atti : 1.f)
-            : (e > 0.f ? e - deci : 0.f));
-  }
+// formant frequency scaling, fo/48000^2, as w0/48000 at
+// 48 kHz: so that other rates sound the same
+#define k_psmodfm_fscale (4.34027777777778e-010f) // 1/48000^2
 
-  float val() { return e;}
-};
+// time constant of the shape, shift-shape and menu parameters (s)
+#define k_psmodfm_smooth (0.01f)
+
+typedef dsp::Smoother<dsp::k_smooth_onepole> ParamSmoother;
+typedef dsp::Smoother<dsp::k_smooth_linear> BlockRamp;
 
 struct PSModFM {
-  float phase, sphase;
-  float z;
-  float ff, ffz;
-  float lfo;
-  float shft;
+  dsp::PhaseAccumulator ph, sph;
+  // formant freq and Q, shift and env amount, smoothed at
+  // block rate; the formant frequency, its index and the
+  // LFO ramp across each block
+  ParamSmoother ff, z, shft, amnt;
+  BlockRamp ffr, ndx, lfo;
   int16_t smax;
   int16_t fmode;
-  float att, dec, amnt;
-  Env env;
-
-  PSModFM() :  phase(0.f), sphase(0.f), z(0.f),
-               ff(0.f), ffz(0.f), lfo(0.f), 
-               shft(0.f), smax(0), fmode(0), att(0.f), dec(0.f),
-               amnt(0.f), env() { };
-    
-
-  float synthesise(float ndx, float a, float pc1, float pc2, float pm) {
-    return (a * osc_cosf(pc2) + (1.f - a) * osc_cosf(pc1)) *
-      EXP(ndx * (osc_cosf(pm) - 1.f));
+  // envelope attack, decay and release (0 - 1, as 0 - 10 s)
+  // and sustain level
+  float att, dcy, sus, rel;
+  bool smooth;
+  dsp::ADSREnvelope env;
+
+  PSModFM() :  ph(), sph(), ff(), z(), shft(), amnt(), ffr(), ndx(), lfo(),
+               smax(0), fmode(0), att(0.f), dcy(MODFM_ENV_DECAY * 0.01f),
+               sus(MODFM_ENV_SUSTAIN * 0.01f), rel(0.f), smooth(false),
+               env() { };
+
+  // parameters set before the first block, with no smoothing
+  // time yet, take effect at once
+  void start_smoothing() {
+    smooth = true;
+    ff.time(k_psmodfm_smooth);
+    z.time(k_psmodfm_smooth);
+    shft.time(k_psmodfm_smooth);
+    amnt.time(k_psmodfm_smooth);
   }
 
   float mod_ndx(float fo, float ff) {
-    float kbw, g,gm;
-    kbw = ff / (.5f + 3.5f * z); // Q: 0.5 to 4
-    g = POW2(-fo / (.29f * kbw));
-    gm = 1. - g;
-    return 2*g/(gm*gm);
+    const float kbw = ff / (.5f + 3.5f * z.val()); // Q: 0.5 to 4
+    return ModFMOp::index(fo, kbw);
   }
 };
 
 static PSModFM obj;
 
+// extended parameters, set by host builds only
+enum {
+  k_psmodfm_param_decay = k_num_user_osc_param_id, // envelope decay
+  k_psmodfm_param_sustain                          // envelope sustain
+};
+
 void OSC_INIT(uint32_t platform, uint32_t api) {
+  Math::init();
 }
 
 void OSC_CYCLE(const user_osc_param_t *const params, int32_t *yn,
                const uint32_t frames) {
-  Env &env = obj.env;
-  const float amnt = obj.amnt*32.f;
-  const float fmax = 12000.f; // max formant freq
+  OSC_PROF_BEGIN(derive, "derive");
+  dsp::ADSREnvelope &env = obj.env;
+  obj.ff.step(frames);
+  obj.z.step(frames);
+  obj.shft.step(frames);
+  obj.amnt.step(frames);
+  const float amnt = obj.amnt.val()*32.f;
+  const float fmax = 12000.f; // max formant freq, at any rate
   const float w0 = osc_w0f_for_note((params->pitch) >> 8, params->pitch & 0xFF);
   const float fo = w0 * k_samplerate;
-  const float fo1 = w0 * k_samplerate_recipf;
-  const float ws = w0 * obj.shft * (1 + obj.smax);
+  const float fo1 = w0 * (k_samplerate * k_psmodfm_fscale);
+  const float ws = w0 * obj.shft.val() * (1 + obj.smax);
+  const float ffv = obj.ff.val();
   const float ff =
-    obj.fmode ? fmax*POW2((obj.ff - 1.)*(obj.fmode+1)) : fo * POW(fmax * fo1, obj.ff);
+    obj.fmode ? fmax*Math::pow2((ffv - 1.)*(obj.fmode+1)) :
+    fo * Math::pow(fmax * fo1, ffv);
   const float ffmx = ff*(1.f + amnt * env.val());
-  const float ndx = obj.mod_ndx(fo, ffmx < fmax ? ffmx : fmax);
-  const float lfo = q31_to_f32(params->shape_lfo);
-  float lfoz =  obj.lfo;
-  float ffz =   obj.ffz;
-  const float frameo1 = 1./frames;
-  const float lfo_inc = (lfo - lfoz)*frameo1;
-  const float ff_inc = (ff - ffz)*frameo1;
-  float phase =  obj.phase;
-  float sphase = obj.sphase;
-
-  
- 
-  for (int i = 0; i < frames; i++) {
-    q31_t *__restrict y = (q31_t *) yn;
-    float ff_mod, a, pc1, pc2, e;
-    int m, k = 0;
-    e = 1.f + amnt * env.proc();
-    ff_mod = (ffz + lfoz * ff)*e;
-    ff_mod = (ff_mod < fmax ? (ff_mod > fo ? ff_mod : fo) : fmax) * fo1;
-    m =  (uint32_t) ff_mod;
-    a = ff_mod - m;
-    pc1 = phase * m + sphase;
-    pc1 -= (uint32_t) pc1;
-    pc2 = phase * (m + 1) + sphase;
-    pc2 -= (uint32_t) pc2;
-    y[i] = f32_to_q31(obj.synthesise(ndx, a, pc1, pc2, phase));
-    phase += w0;
-    phase -= (uint32_t) phase;
-    sphase += ws;
-    sphase -= (uint32_t) sphase;
-    lfoz += lfo_inc;
-    ffz += ff_inc;
+  const float ndxt = obj.mod_ndx(fo, ffmx < fmax ? ffmx : fmax);
+  const float lfov = q31_to_f32(params->shape_lfo);
+  if (obj.smooth) {
+    obj.ffr.set(ff, frames);
+    obj.ndx.set(ndxt, frames);
+    obj.lfo.set(lfov, frames);
+  } else {
+    obj.ffr.reset(ff);
+    obj.ndx.reset(ndxt);
+    obj.lfo.reset(lfov);
+  }
+  float ffz = obj.ffr.val(), ndx = obj.ndx.val(), lfoz = obj.lfo.val();
+  const float ff_inc = obj.ffr.step(frames);
+  const float ndx_inc = obj.ndx.step(frames);
+  const float lfo_inc = obj.lfo.step(frames);
+  dsp::PhaseAccumulator ph(obj.ph.mPhase, w0);
+  dsp::PhaseAccumulator sph(obj.sph.mPhase, ws);
+  OSC_PROF_END(derive, 0);
+
+  // envelope, formant mapping, synthesis and conversion, per
+  // frame, in spans between envelope breakpoints
+  OSC_PROF_BEGIN(synth, "synth");
+  q31_t *__restrict y = (q31_t *) yn;
+  for (uint32_t i = 0; i < frames; ) {
+    const uint32_t len = env.span(frames - i);
+    for (const uint32_t end = i + len; i < end; i++) {
+      float ff_mod, a, pc1, pc2, e;
+      int m;
+      const float phase = ph.process();
+      const float sphase = sph.process();
+      e = 1.f + amnt * env.tick();
+      ff_mod = (ffz + lfoz * ff)*e;
+      ff_mod = (ff_mod < fmax ? (ff_mod > fo ? ff_mod : fo) : fmax) * fo1;
+      m =  (uint32_t) ff_mod;
+      a = ff_mod - m;
+      pc1 = phase * m + sphase;
+      pc1 -= (uint32_t) pc1;
+      pc2 = phase * (m + 1) + sphase;
+      pc2 -= (uint32_t) pc2;
+      y[i] = f32_to_q31(ModFMOp::process(ndx, a, pc1, pc2, phase));
+      lfoz += lfo_inc;
+      ffz += ff_inc;
+      ndx += ndx_inc;
+    }
+    env.skip(len);
   }
-  obj.phase = phase;
-  obj.sphase = sphase;
-  obj.lfo = lfoz;
-  obj.ffz = ffz;
+  OSC_PROF_END(synth, frames);
+  obj.ph = ph;
+  obj.sph = sph;
+  if (!obj.smooth) obj.start_smoothing();
 }
 
 void OSC_NOTEON(const user_osc_param_t *const params) {
-  const float att = POW(11.f, obj.att) - 1.f;
-  const float dec = POW(11.f, obj.dec) - 1.f;
-  obj.env.init(att, dec);
+  const float att = Math::pow(11.f, obj.att) - 1.f;
+  const float dcy = Math::pow(11.f, obj.dcy) - 1.f;
+  const float rel = Math::pow(11.f, obj.rel) - 1.f;
+  obj.env.init(att, dcy, obj.sus, rel);
 }
 
-void OSC_NOTEOFF(const user_osc_param_t *const params) { obj.env.decay(); }
+void OSC_NOTEOFF(const user_osc_param_t *const params) { obj.env.release(); }
 
 void OSC_PARAM(uint16_t index, uint16_t value) {
   const float valf = param_val_to_f32(value);
@@ -148,7 +170,7 @@ void OSC_PARAM(uint16_t index, uint16_t value) {
     break;
   case k_user_osc_param_id2:
     // mod freq shift
-    obj.shft = clip01f(value * 0.01f);
+    obj.shft.set(clip01f(value * 0.01f));
     break;
   case k_user_osc_param_id3:
     // freq tracking mode
@@ -159,20 +181,26 @@ void OSC_PARAM(uint16_t index, uint16_t value) {
     obj.att = clip01f(value * 0.01f);
     break;
   case k_user_osc_param_id5:
-    // env dec
-    obj.dec = clip01f(value * 0.01f);
+    // env release
+    obj.rel = clip01f(value * 0.01f);
     break;
   case k_user_osc_param_id6:
     // env amount
-    obj.amnt = clip01f(value * 0.01f);
+    obj.amnt.set(clip01f(value * 0.01f));
     break;
   case k_user_osc_param_shape:
     // formant freq (0-1)
-    obj.ff = valf;
+    obj.ff.set(valf);
     break;
   case k_user_osc_param_shiftshape:
     // formant Q (0 - 1)
-    obj.z = valf;
+    obj.z.set(valf);
+    break;
+  case k_psmodfm_param_decay:
+    obj.dcy = clip01f(value * 0.01f);
+    break;
+  case k_psmodfm_param_sustain:
+    obj.sus = clip01f(value * 0.01f);
     break;
   default:
     break;
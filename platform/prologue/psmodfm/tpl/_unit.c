@@ -40,6 +40,9 @@
  */
 
 #include "userosc.h"
+#ifdef OSC_TRACE
+#include "osc_trace.h"
+#endif
 
 /*===========================================================================*/
 /* Externs and Types.                                                        */
@@ -69,6 +72,80 @@ typedef void (*__init_fptr)(void);
  * @{
  */
 
+#ifdef OSC_TRACE
+
+// Tracing shim: with OSC_TRACE defined, the hook table points to
+// wrappers that log each call (osc_trace.h) before making it. The
+// log fills osc_trace_log from the entry call on, then stops and
+// counts the calls it missed; its first osc_trace_len bytes, read
+// off the unit's memory, are a trace file for the host replayer.
+
+#ifndef OSC_TRACE_SIZE
+#define OSC_TRACE_SIZE (4096)
+#endif
+
+__attribute__((used))
+uint8_t osc_trace_log[OSC_TRACE_SIZE];
+__attribute__((used))
+uint32_t osc_trace_len, osc_trace_dropped;
+
+static osc_trace_state_t s_trace;
+
+static void trace(uint8_t type, const user_osc_param_t * const params,
+                  uint32_t frames, uint32_t x, uint32_t y)
+{
+  if (osc_trace_len + k_osc_trace_max_record > OSC_TRACE_SIZE) {
+    osc_trace_dropped++;
+    return;
+  }
+  osc_trace_len += osc_trace_encode(&s_trace, osc_trace_log + osc_trace_len,
+                                    type, params, frames, x, y);
+}
+
+static void _trace_cycle(const user_osc_param_t * const params, int32_t *yn, const uint32_t frames)
+{
+  trace(k_osc_trace_cycle, params, frames, 0, 0);
+  _hook_cycle(params, yn, frames);
+}
+
+static void _trace_on(const user_osc_param_t * const params)
+{
+  trace(k_osc_trace_on, params, 0, 0, 0);
+  _hook_on(params);
+}
+
+static void _trace_off(const user_osc_param_t * const params)
+{
+  trace(k_osc_trace_off, params, 0, 0, 0);
+  _hook_off(params);
+}
+
+static void _trace_mute(const user_osc_param_t * const params)
+{
+  trace(k_osc_trace_mute, params, 0, 0, 0);
+  _hook_mute(params);
+}
+
+static void _trace_value(uint16_t value)
+{
+  trace(k_osc_trace_value, NULL, 0, value, 0);
+  _hook_value(value);
+}
+
+static void _trace_param(uint16_t index, uint16_t value)
+{
+  trace(k_osc_trace_param, NULL, 0, index, value);
+  _hook_param(index, value);
+}
+
+#define OSC_HOOK(name) _trace_##name
+
+#else
+
+#define OSC_HOOK(name) _hook_##name
+
+#endif
+
 __attribute__((used, section(".hooks")))
 static const user_osc_hook_table_t s_hook_table = {
   .magic = {'U','O','S','C'},
@@ -76,12 +153,12 @@ static const user_osc_hook_table_t s_hook_table = {
   .platform = USER_TARGET_PLATFORM>>8,
   .reserved0 = {0},
   .func_entry = _entry,
-  .func_cycle = _hook_cycle,
-  .func_on = _hook_on,
-  .func_off = _hook_off,
-  .func_mute = _hook_mute,
-  .func_value = _hook_value,
-  .func_param = _hook_param,
+  .func_cycle = OSC_HOOK(cycle),
+  .func_on = OSC_HOOK(on),
+  .func_off = OSC_HOOK(off),
+  .func_mute = OSC_HOOK(mute),
+  .func_value = OSC_HOOK(value),
+  .func_param = OSC_HOOK(param),
   .reserved1 = {0}
 };
 
@@ -114,6 +191,12 @@ void _entry(uint32_t platform, uint32_t api)
       init_p();
   }
   
+#ifdef OSC_TRACE
+  osc_trace_reset(&s_trace);
+  osc_trace_len = osc_trace_header(osc_trace_log, k_samplerate);
+  trace(k_osc_trace_init, NULL, 0, platform, api);
+#endif
+
   // Call user initialization
   _hook_init(platform, api);
 }
@@ -0,0 +1,259 @@
+#!/usr/bin/env python3
+#  User oscillator size analyser
+#  Copyright 2020 Victor Lazzarini
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+"""Break down the SRAM used by a linked unit, per section and per
+function and table, and check it against the unit region budget.
+
+usage: oscsize.py [options] unit.elf
+  -b bytes   budget (default 32768, the userosc.ld SRAM region)
+  -n count   symbols listed, largest first (default 20, 0 for all)
+  -c file    compare with a previous build, an ELF or a -o file
+  -g bytes   fail if the total grew by more than this over -c
+  -o file    save this build's sizes, for a later -c
+
+Sizes come from the ELF section headers and symbol table: text
+(.hooks, .text), rodata, data (.data, .init_array) and bss. Bytes
+not covered by a sized symbol (literals, padding) are listed as
+"(other)". Firmware symbols (osc_api.syms) are absolute and not
+counted. Exits with 1 when over budget or over the -g growth.
+"""
+
+import getopt
+import json
+import struct
+import subprocess
+import sys
+
+BUDGET = 32768
+SECTIONS = ('text', 'rodata', 'data', 'bss')
+
+SHF_ALLOC = 0x2
+SHT_SYMTAB = 2
+SHN_UNDEF = 0
+SHN_LORESERVE = 0xff00
+SHN_COMMON = 0xfff2
+STT_OBJECT = 1
+STT_FUNC = 2
+
+
+def fail(msg):
+    sys.stderr.write('oscsize: ' + msg + '\n')
+    sys.exit(2)
+
+
+def section_kind(name):
+    if name.startswith(('.text', '.hooks')):
+        return 'text'
+    if name.startswith('.rodata'):
+        return 'rodata'
+    if name.startswith('.bss'):
+        return 'bss'
+    if name.startswith(('.data', '.init_array')):
+        return 'data'
+    return None
+
+
+def demangle(names):
+    # c++filt from the toolchain, or the host's, if there is one
+    for tool in ('arm-none-eabi-c++filt', 'c++filt'):
+        try:
+            out = subprocess.run([tool], input='\n'.join(names),
+                                 stdout=subprocess.PIPE,
+                                 universal_newlines=True).stdout
+            lines = out.split('\n')
+            if len(lines) >= len(names):
+                return dict(zip(names, lines))
+        except OSError:
+            pass
+    return {n: n for n in names}
+
+
+def analyse(path):
+    """Sizes of an ELF file: section totals, and symbols as
+    name -> [section kind, bytes]"""
+    try:
+        with open(path, 'rb') as f:
+            elf = f.read()
+    except OSError as e:
+        fail('%s: %s' % (path, e.strerror))
+    if elf[:4] != b'\x7fELF':
+        fail('%s: not an ELF file' % path)
+    wide = elf[4] == 2
+    end = '<' if elf[5] == 1 else '>'
+    if wide:
+        shoff, = struct.unpack_from(end + 'Q', elf, 0x28)
+        shentsize, shnum, shstrndx = struct.unpack_from(end + 'HHH', elf, 0x3a)
+        shfmt, symfmt = end + 'IIQQQQIIQQ', end + 'IBBHQQ'
+    else:
+        shoff, = struct.unpack_from(end + 'I', elf, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from(end + 'HHH', elf, 0x2e)
+        shfmt, symfmt = end + 'IIIIIIIIII', end + 'IIIBBH'
+
+    shdrs = []
+    for i in range(shnum):
+        h = struct.unpack_from(shfmt, elf, shoff + i * shentsize)
+        # name, type, flags, offset, size, link, entsize
+        shdrs.append((h[0], h[1], h[2], h[4], h[5], h[6], h[9]))
+
+    def string(table, ofs):
+        base = shdrs[table][3] + ofs
+        return elf[base:elf.index(b'\0', base)].decode('latin-1')
+
+    kinds = [None] * shnum
+    sections = dict.fromkeys(SECTIONS, 0)
+    for i, (name, typ, flags, _, size, _, _) in enumerate(shdrs):
+        if flags & SHF_ALLOC:
+            kinds[i] = section_kind(string(shstrndx, name))
+            if kinds[i] is not None:
+                sections[kinds[i]] += size
+
+    symbols = {}
+    for name, typ, _, ofs, size, link, entsize in shdrs:
+        if typ != SHT_SYMTAB:
+            continue
+        for k in range(ofs + entsize, ofs + size, entsize):
+            s = struct.unpack_from(symfmt, elf, k)
+            if wide:
+                sname, info, shndx, ssize = s[0], s[1], s[3], s[5]
+            else:
+                sname, ssize, info, shndx = s[0], s[2], s[3], s[5]
+            if info & 0xf not in (STT_OBJECT, STT_FUNC) or ssize == 0:
+                continue
+            if shndx == SHN_COMMON:
+                kind = 'bss'  # unallocated yet, in relocatable objects
+                sections['bss'] += ssize
+            elif shndx == SHN_UNDEF or shndx >= SHN_LORESERVE:
+                continue
+            else:
+                kind = kinds[shndx]
+            if kind is None:
+                continue
+            n = string(link, sname)
+            # statics of the same name in different files add up
+            if n in symbols and symbols[n][0] == kind:
+                symbols[n][1] += ssize
+            else:
+                symbols[n] = [kind, ssize]
+
+    names = demangle(list(symbols))
+    symbols = {names[n]: v for n, v in symbols.items()}
+    for kind in SECTIONS:
+        rest = sections[kind] - sum(v[1] for v in symbols.values()
+                                    if v[0] == kind)
+        if rest > 0:
+            symbols['(other %s)' % kind] = [kind, rest]
+    return {'total': sum(sections.values()), 'sections': sections,
+            'symbols': symbols}
+
+
+def load(path):
+    with open(path, 'rb') as f:
+        magic = f.read(4)
+    if magic == b'\x7fELF':
+        return analyse(path)
+    try:
+        with open(path) as f:
+            return json.load(f)
+    except (OSError, ValueError) as e:
+        fail('%s: %s' % (path, e))
+
+
+def delta(new, old):
+    d = new - old
+    return '%+7d' % d if d else ' ' * 7
+
+
+def report(path, cur, budget, count, base):
+    total = cur['total']
+    print('%s: %d of %d bytes (%.1f%%), %d %s' %
+          (path, total, budget, 100. * total / budget, abs(budget - total),
+           'free' if total <= budget else 'OVER BUDGET'))
+    print()
+    for kind in SECTIONS:
+        line = '  %-8s %7d' % (kind, cur['sections'][kind])
+        if base is not None:
+            line += ' ' + delta(cur['sections'][kind],
+                                base['sections'].get(kind, 0))
+        print(line)
+    print()
+
+    syms = sorted(cur['symbols'].items(), key=lambda s: (-s[1][1], s[0]))
+    shown = syms if count == 0 else syms[:count]
+    for name, (kind, size) in shown:
+        line = '  %-8s %7d' % (kind, size)
+        if base is not None:
+            old = base['symbols'].get(name, [kind, 0])[1]
+            line += ' ' + delta(size, old)
+        print(line + '  ' + name)
+    if len(shown) < len(syms):
+        print('  ... %d more' % (len(syms) - len(shown)))
+
+    if base is None:
+        return
+    # regressions: anything that grew or appeared, largest first
+    print()
+    grown = []
+    for name, (kind, size) in syms:
+        old = base['symbols'].get(name, [kind, 0])[1]
+        if size > old:
+            grown.append((size - old, name, old == 0))
+    gone = [n for n in base['symbols'] if n not in cur['symbols']]
+    for d, name, new in sorted(grown, key=lambda g: (-g[0], g[1])):
+        print('  grew %+7d  %s%s' % (d, name, ' (new)' if new else ''))
+    for name in sorted(gone):
+        print('  gone %+7d  %s' % (-base['symbols'][name][1], name))
+    print('  total %+d bytes against the previous build' %
+          (total - base['total']))
+
+
+def main(argv):
+    try:
+        opts, args = getopt.getopt(argv[1:], 'b:n:c:g:o:h')
+    except getopt.GetoptError as e:
+        fail(str(e))
+    opts = dict(opts)
+    if '-h' in opts or len(args) != 1:
+        sys.exit(__doc__)
+    try:
+        budget = int(opts.get('-b', str(BUDGET)), 0)
+        count = int(opts.get('-n', 20))
+        growth = int(opts['-g'], 0) if '-g' in opts else None
+    except ValueError as e:
+        fail(str(e))
+
+    cur = analyse(args[0])
+    base = load(opts['-c']) if '-c' in opts else None
+    report(args[0], cur, budget, count, base)
+    if '-o' in opts:
+        with open(opts['-o'], 'w') as f:
+            json.dump(cur, f, indent=1, sort_keys=True)
+
+    status = 0
+    if cur['total'] > budget:
+        print('oscsize: %s is %d bytes over its %d byte budget' %
+              (args[0], cur['total'] - budget, budget))
+        status = 1
+    if base is not None and growth is not None and \
+       cur['total'] - base['total'] > growth:
+        print('oscsize: %s grew by %d bytes, more than %d' %
+              (args[0], cur['total'] - base['total'], growth))
+        status = 1
+    sys.exit(status)
+
+
+if __name__ == '__main__':
+    main(sys.argv)